@@ -0,0 +1,64 @@
+#include "common.h"
+#include "memory.h"
+#include "module.h"
+#include "archive.h"
+
+static void
+usage(void)
+{
+	printf("Usage:\n\tFVMar <archive.fva> <module.fvb>...\n");
+	printf("\tEvery module is named after its file, without the directory and the extension.\n");
+	exit(1);
+}
+
+/** @returns char*: the name of the module at 'path', e.g. "lib/math.fvb" -> "math". */
+static char*
+moduleName(const char* path)
+{
+	const char* start = strrchr(path, '/');
+	start = (start != NULL) ? start + 1 : path;
+
+	const char* end = strrchr(start, '.');
+	if (end == NULL || end == start)
+		end = start + strlen(start);
+
+	uint32_t len = (uint32_t)(end - start);
+	char* name = ALLOCATE(char, len + 1);
+	memcpy(name, start, len);
+	name[len] = '\0';
+	return name;
+}
+
+int
+main(int argc, char* argv[])
+{
+	if (argc < 3)
+		usage();
+#if defined(FUNVM_MEM_MANAGER)
+	heapInit();
+#endif
+	uint32_t count = (uint32_t)(argc - 2);
+	ByteCode* modules = ALLOCATE(ByteCode, count);
+	const char** names = ALLOCATE(const char*, count);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		initByteCode(&modules[i]);
+		if (!readModule(argv[i + 2], &modules[i]))
+			exit(74);
+
+		names[i] = moduleName(argv[i + 2]);
+	}
+
+	if (!writeArchive(argv[1], names, modules, count))
+		exit(74);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		FREE_ARRAY(char, (void*)names[i], strlen(names[i]) + 1);
+		freeByteCode(&modules[i]);
+	}
+
+	FREE_ARRAY(const char*, names, count);
+	FREE_ARRAY(ByteCode, modules, count);
+	freeObjects();
+	return (0);
+}
\ No newline at end of file
@@ -0,0 +1,417 @@
+#include "archive.h"
+#include "module.h"
+#include "memory.h"
+#include "byte_order.h"
+#include "hash_table.h"
+
+#define INDEX_HEADER_SIZE	(2 * sizeof(uint32_t))
+#define INDEX_ENTRY_SIZE	(6 * sizeof(uint32_t))
+
+typedef struct {
+	uint32_t nameHash;
+	uint32_t nameOffset;
+	uint32_t nameLen;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t checksum;
+} IndexEntry;
+
+/* ------------------------------- Writer ------------------------------- */
+
+/**
+ * Packs the strings of all the modules into 'shared', each distinct string once,
+ * and fills 'offsets' with the offset of every module's string within it.
+ */
+static void
+shareStrings(ByteCode* modules, uint32_t count, ObjPool* shared, uint32_t* offsets)
+{
+	Table seen;
+	Table interned;
+	Obj* objects = NULL;
+	StringSet set = { &interned, &objects };	// 'shared' keeps copies of the strings.
+	uint32_t next = 0;
+
+	initTable(&seen);
+	initTable(&interned);
+	for (uint32_t m = 0; m < count; ++m) {
+		ObjPool* objPool = &modules[m].objects;
+
+		for (uint32_t i = 0; i < objPool->count; ++i) {
+			PoolString* desc = &objPool->entries[i];
+			ObjString* str = internHashed(&set, OBJPOOL_STR_CHARS(objPool, i), desc->len, desc->hash);
+			Value offset;
+
+			if (!tableGet(&seen, str, &offset)) {
+				offset = NUM_PACK(shared->size);
+				writeObjPool(shared, str);
+				tableSet(&seen, str, offset);
+			}
+
+			offsets[next++] = NUM_UNPACK(offset);
+		}
+	}
+
+	freeTable(&seen);
+	freeTable(&interned);
+	freeObjectList(objects);
+}
+
+static bool
+putRecord(ContainerWriter* writer, ByteCode* bCode, uint32_t* offsets)
+{
+	bool result;
+
+	putVarint(writer, bCode->count);
+	putBytes(writer, bCode->code, bCode->count);
+
+	putVarint(writer, constantsSize(&bCode->constants));
+	result = putConstants(writer, &bCode->constants);
+
+	closeLineTable(&bCode->lines);
+	putVarint(writer, bCode->lines.size);
+	putBytes(writer, bCode->lines.runs, bCode->lines.size);
+
+	putVarint(writer, bCode->objects.count);
+	for (uint32_t i = 0; i < bCode->objects.count; ++i)
+		putVarint(writer, offsets[i]);
+
+	return result;
+}
+
+static void
+putIndex(ContainerWriter* writer, const char** names, IndexEntry* entries, uint32_t count)
+{
+	uint32_t bucketCount = 1;
+	while (bucketCount < count * 2)
+		bucketCount <<= 1;
+
+	uint32_t* buckets = ALLOCATE(uint32_t, bucketCount);
+	memset(buckets, 0, sizeof(uint32_t) * bucketCount);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t bucket = entries[i].nameHash & (bucketCount - 1);
+		while (buckets[bucket] != 0)
+			bucket = (bucket + 1) & (bucketCount - 1);
+
+		buckets[bucket] = i + 1;
+	}
+
+	putU32(writer, count);
+	putU32(writer, bucketCount);
+	for (uint32_t i = 0; i < bucketCount; ++i)
+		putU32(writer, buckets[i]);
+
+	for (uint32_t i = 0; i < count; ++i) {
+		putU32(writer, entries[i].nameHash);
+		putU32(writer, entries[i].nameOffset);
+		putU32(writer, entries[i].nameLen);
+		putU32(writer, entries[i].offset);
+		putU32(writer, entries[i].size);
+		putU32(writer, entries[i].checksum);
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+		putBytes(writer, names[i], entries[i].nameLen);
+
+	FREE_ARRAY(uint32_t, buckets, bucketCount);
+}
+
+/**
+ * Writes the given modules, named by 'names', into the file at 'path' in .fva format.
+ * @returns bool: false if a name is repeated, a module uses instruction words or
+ * the file couldn't be written.
+ */
+bool
+writeArchive(const char* path, const char** names, ByteCode* modules, uint32_t count)
+{
+	ContainerWriter writer;
+	ObjPool shared;
+	IndexEntry* entries;
+	uint32_t* offsets;
+	uint32_t stringCount = 0;
+	uint32_t nameOffset  = 0;
+	bool result = true;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		for (uint32_t j = 0; j < i; ++j) {
+			if (strcmp(names[i], names[j]) == 0) {
+				fprintf(stderr, "Module '%s' is given more than once.\n", names[i]);
+				return false;
+			}
+		}
+
+		// Module code isn't aligned within an archive, words would lose their point.
+		if (modules[i].encoding != enc_bytes) {
+			fprintf(stderr, "Module '%s' uses instruction words, archives hold byte-encoded code only.\n", names[i]);
+			return false;
+		}
+
+		stringCount += modules[i].objects.count;
+	}
+
+	if (!beginContainer(&writer, path, 3))
+		return false;
+
+	initObjPool(&shared);
+	offsets = ALLOCATE(uint32_t, stringCount);
+	entries = ALLOCATE(IndexEntry, count);
+	shareStrings(modules, count, &shared, offsets);
+
+	beginSection(&writer, sec_shared_strings);
+	putBytes(&writer, shared.values, shared.size);
+	endSection(&writer);
+
+	beginSection(&writer, sec_modules);
+	for (uint32_t i = 0, first = 0; i < count; ++i) {
+		IndexEntry* entry = &entries[i];
+
+		entry->nameLen    = (uint32_t)strlen(names[i]);
+		entry->nameHash   = fvbChecksum(FVB_CHECKSUM_SEED, (const uint8_t*)names[i], entry->nameLen);
+		entry->nameOffset = nameOffset;
+		nameOffset += entry->nameLen;
+
+		entry->offset = writer.pos - writer.sections[writer.sectionCount].offset;
+		writer.record = FVB_CHECKSUM_SEED;
+		result = putRecord(&writer, &modules[i], offsets + first) && result;
+		entry->size     = writer.pos - writer.sections[writer.sectionCount].offset - entry->offset;
+		entry->checksum = writer.record;
+		first += modules[i].objects.count;
+	}
+	endSection(&writer);
+
+	beginSection(&writer, sec_index);
+	putIndex(&writer, names, entries, count);
+	endSection(&writer);
+
+	result = endContainer(&writer, path, FVA_MAGIC, FVA_VERSION_MAJOR, FVA_VERSION_MINOR) && result;
+
+	FREE_ARRAY(IndexEntry, entries, count);
+	FREE_ARRAY(uint32_t, offsets, stringCount);
+	freeObjPool(&shared);
+	return result;
+}
+
+/* ------------------------------- Reader ------------------------------- */
+
+static const char*
+parseIndex(Archive* archive)
+{
+	uint32_t size = archive->indexSize;
+
+	if (size < INDEX_HEADER_SIZE)
+		return "has a corrupted index";
+
+	archive->moduleCount = loadU32(archive->index);
+	archive->bucketCount = loadU32(archive->index + sizeof(uint32_t));
+	size -= INDEX_HEADER_SIZE;
+
+	if (archive->bucketCount == 0 || (archive->bucketCount & (archive->bucketCount - 1)) != 0 ||
+		archive->bucketCount > size / sizeof(uint32_t))
+		return "has a corrupted index";
+
+	size -= archive->bucketCount * sizeof(uint32_t);
+	if (archive->moduleCount > size / INDEX_ENTRY_SIZE)
+		return "has a corrupted index";
+
+	return NULL;
+}
+
+/**
+ * Opens the archive at 'path' and loads its index and shared strings, the modules
+ * are loaded by loadArchiveModule(). If 'mapped' is set (and supported), the whole
+ * file is mapped and the modules are executed in place.
+ * @returns bool: false if the file can't be opened or isn't a valid archive.
+ */
+bool
+openArchive(Archive* archive, const char* path, bool mapped)
+{
+	FvbSection* index;
+	FvbSection* strings;
+	FvbSection* modules;
+	const char* error = NULL;
+
+	archive->index       = NULL;
+	archive->indexSize   = 0;
+	archive->strings     = NULL;
+	archive->stringsSize = 0;
+
+	if (!openContainer(&archive->container, path, FVA_MAGIC, FVA_VERSION_MAJOR, mapped))
+		return false;
+
+	index   = findSection(&archive->container, sec_index);
+	strings = findSection(&archive->container, sec_shared_strings);
+	modules = findSection(&archive->container, sec_modules);
+
+	do {
+		if (index == NULL || strings == NULL || modules == NULL) {
+			error = "has a corrupted section table";
+			break;
+		}
+
+		if (!fetchSection(&archive->container, index, &archive->index) ||
+			!fetchSection(&archive->container, strings, &archive->strings)) {
+			error = "has a corrupted section";
+			break;
+		}
+
+		archive->indexSize     = index->size;
+		archive->stringsSize   = strings->size;
+		archive->modulesOffset = modules->offset;
+		archive->modulesSize   = modules->size;
+		error = parseIndex(archive);
+	} while (0);
+
+	if (error != NULL) {
+		containerError(&archive->container, error);
+		closeArchive(archive);
+		return false;
+	}
+
+	return true;
+}
+
+/** Releases the archive. Modules loaded from a mapped archive keep pointing into
+ * it, so they must be freed before. */
+void
+closeArchive(Archive* archive)
+{
+	Container* container = &archive->container;
+
+	if (archive->index != NULL)
+		releaseRange(container, archive->index, archive->indexSize);
+
+	if (archive->strings != NULL)
+		releaseRange(container, archive->strings, archive->stringsSize);
+
+	closeContainer(container);
+	if (container->image != NULL)
+		unmapImage(container->image, container->size);
+
+	archive->index   = NULL;
+	archive->strings = NULL;
+	container->image = NULL;
+}
+
+/** @returns const uint8_t*: the index entry of the module called 'name' or NULL. */
+static const uint8_t*
+findModule(Archive* archive, const char* name)
+{
+	const uint8_t* buckets = archive->index + INDEX_HEADER_SIZE;
+	const uint8_t* entries = buckets + archive->bucketCount * sizeof(uint32_t);
+	const uint8_t* names   = entries + archive->moduleCount * INDEX_ENTRY_SIZE;
+	uint32_t namesSize = (uint32_t)(archive->index + archive->indexSize - names);
+	uint32_t len  = (uint32_t)strlen(name);
+	uint32_t hash = fvbChecksum(FVB_CHECKSUM_SEED, (const uint8_t*)name, len);
+	uint32_t mask = archive->bucketCount - 1;
+
+	for (uint32_t probe = 0; probe < archive->bucketCount; ++probe) {
+		uint32_t bucket = loadU32(buckets + ((hash + probe) & mask) * sizeof(uint32_t));
+		if (bucket == 0 || bucket > archive->moduleCount)
+			return NULL;
+
+		const uint8_t* entry = entries + (bucket - 1) * INDEX_ENTRY_SIZE;
+		uint32_t nameOffset = loadU32(entry + 4);
+
+		if (loadU32(entry) == hash && loadU32(entry + 8) == len &&
+			nameOffset <= namesSize && len <= namesSize - nameOffset &&
+			memcmp(names + nameOffset, name, len) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/** Reads the varint size of the next part of a record and checks it fits. */
+static bool
+readPart(uint8_t** pos, const uint8_t* end, uint32_t* size)
+{
+	uint32_t varLen = loadVarint(*pos, end, size);
+	if (varLen == 0 || *size > (uint32_t)(end - *pos - varLen))
+		return false;
+
+	*pos += varLen;
+	return true;
+}
+
+static bool
+decodeRecord(Archive* archive, uint8_t* data, uint32_t size, ByteCode* bCode)
+{
+	const uint8_t* end = data + size;
+	uint8_t* pos = data;
+	uint32_t partSize;
+	uint32_t varLen;
+
+	if (!readPart(&pos, end, &partSize))
+		return false;
+
+	bCode->code     = pos;
+	bCode->count    = partSize;
+	bCode->capacity = partSize;
+	pos += partSize;
+
+	if (!readPart(&pos, end, &partSize) || !decodeConstants(pos, partSize, &bCode->constants))
+		return false;
+
+	pos += partSize;
+
+	if (!readPart(&pos, end, &partSize))
+		return false;
+
+	bCode->lines.runs     = pos;
+	bCode->lines.size     = partSize;
+	bCode->lines.capacity = partSize;
+	pos += partSize;
+
+	varLen = loadVarint(pos, end, &partSize);
+	if (varLen == 0)
+		return false;
+
+	bCode->objects.values = archive->strings;
+	bCode->objects.size   = archive->stringsSize;
+	return indexSharedObjPool(&bCode->objects, pos + varLen, end, partSize);
+}
+
+/**
+ * Loads the module called 'name' into the given (initialized) bytecode and verifies
+ * its checksum. The bytecode references the shared strings of the archive (and its
+ * mapping, if any), so it must be freed before the archive is closed.
+ * @returns bool: false if there's no such module or it's corrupted.
+ */
+bool
+loadArchiveModule(Archive* archive, const char* name, ByteCode* bCode)
+{
+	const uint8_t* entry = findModule(archive, name);
+	uint8_t* data;
+
+	if (entry == NULL) {
+		fprintf(stderr, "Archive '%s' has no module '%s'.\n", archive->container.path, name);
+		return false;
+	}
+
+	uint32_t offset   = loadU32(entry + 12);
+	uint32_t size     = loadU32(entry + 16);
+	uint32_t checksum = loadU32(entry + 20);
+
+	if (offset > archive->modulesSize || size > archive->modulesSize - offset ||
+		!fetchRange(&archive->container, archive->modulesOffset + offset, size, &data)) {
+		fprintf(stderr, "Archive '%s' has a corrupted module '%s'.\n", archive->container.path, name);
+		return false;
+	}
+
+	if (archive->container.image != NULL) {
+		bCode->storage = storage_borrowed;
+	} else {
+		bCode->storage   = storage_buffer;
+		bCode->image     = data;
+		bCode->imageSize = size;
+	}
+
+	if (fvbChecksum(FVB_CHECKSUM_SEED, data, size) != checksum ||
+		!decodeRecord(archive, data, size, bCode)) {
+		fprintf(stderr, "Archive '%s' has a corrupted module '%s'.\n", archive->container.path, name);
+		freeByteCode(bCode);
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
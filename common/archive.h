@@ -0,0 +1,51 @@
+#ifndef FUNVM_ARCHIVE_H
+#define FUNVM_ARCHIVE_H
+
+#include "common.h"
+#include "bytecode.h"
+#include "container.h"
+
+/* A module archive (.fva file) bundles several modules into one container (see
+ * container.h) with the magic "FVMA" and the following sections:
+ *   sec_index           u32 moduleCount | u32 bucketCount | u32 buckets[bucketCount] |
+ *                       entries[moduleCount] | names
+ *                       The buckets form an open-addressing hash table over the FNV-1a
+ *                       hash of the module names, with linear probing; a bucket holds
+ *                       the index of an entry plus one, or 0 if it's empty. bucketCount
+ *                       is a power of two. Every entry is six u32 fields:
+ *                         nameHash | nameOffset | nameLen | offset | size | checksum
+ *                       where the name lives in 'names' and the module record lives in
+ *                       sec_modules.
+ *   sec_shared_strings  object pool entries (see object_pool.h) of all the modules,
+ *                       every distinct string is stored once.
+ *   sec_modules         module records, each of them:
+ *                         varint codeSize | code | varint constantsSize | constants |
+ *                         varint linesSize | lines | varint stringCount |
+ *                         varint offsets of the strings within sec_shared_strings
+ *                       The code, constants and lines are encoded as in a module.
+ *
+ * Only the index and the shared strings are loaded when an archive is opened, a
+ * module is loaded (and its checksum verified) only once it's asked for. */
+
+#define FVA_MAGIC           "FVMA"
+#define FVA_VERSION_MAJOR   1
+#define FVA_VERSION_MINOR   0
+
+typedef struct {
+	Container container;
+	uint8_t*  index;
+	uint32_t  indexSize;
+	uint32_t  moduleCount;
+	uint32_t  bucketCount;
+	uint8_t*  strings;		/* <! data of sec_shared_strings. */
+	uint32_t  stringsSize;
+	uint32_t  modulesOffset;	/* <! of sec_modules within the file. */
+	uint32_t  modulesSize;
+} Archive;
+
+bool writeArchive(const char* path, const char** names, ByteCode* modules, uint32_t count);
+bool openArchive(Archive* archive, const char* path, bool mapped);
+bool loadArchiveModule(Archive* archive, const char* name, ByteCode* bCode);
+void closeArchive(Archive* archive);
+
+#endif /* FUNVM_ARCHIVE_H */
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef FUNVM_BYTE_ORDER_H
+#define FUNVM_BYTE_ORDER_H
+
+#include "common.h"
+
+/* Everything FunVM puts on disk is little-endian, regardless of the host.
+ * These helpers also tolerate unaligned addresses. */
+
+static inline void
+storeU16(uint8_t* dst, uint16_t value)
+{
+	dst[0] = (uint8_t)(value);
+	dst[1] = (uint8_t)(value >> 8);
+}
+
+static inline void
+storeU32(uint8_t* dst, uint32_t value)
+{
+	dst[0] = (uint8_t)(value);
+	dst[1] = (uint8_t)(value >> 8);
+	dst[2] = (uint8_t)(value >> 16);
+	dst[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint16_t
+loadU16(const uint8_t* src)
+{
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static inline uint32_t
+loadU32(const uint8_t* src)
+{
+	return  (uint32_t)src[0]         |
+			((uint32_t)src[1] << 8)  |
+			((uint32_t)src[2] << 16) |
+			((uint32_t)src[3] << 24);
+}
+
+/* Variable-length integers (LEB128): 7 bits per byte, least significant group
+ * first, the high bit marks that another byte follows. */
+#define VARINT_MAX_LEN		5
+
+/* Zigzag mapping keeps small negative numbers short: 0, -1, 1, -2 -> 0, 1, 2, 3 */
+#define ZIGZAG_ENCODE(value)	(((uint32_t)(value) << 1) ^ (uint32_t)((int32_t)(value) >> 31))
+#define ZIGZAG_DECODE(value)	((int32_t)(((value) >> 1) ^ (0u - ((value) & 1))))
+
+/** @returns uint32_t: the number of bytes written into 'dst'. */
+static inline uint32_t
+storeVarint(uint8_t* dst, uint32_t value)
+{
+	uint32_t len = 0;
+	while (value >= 0x80) {
+		dst[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+
+	dst[len++] = (uint8_t)value;
+	return len;
+}
+
+/** @returns uint32_t: the number of bytes consumed or 0 if the encoding is malformed
+ * or runs past 'end'. */
+static inline uint32_t
+loadVarint(const uint8_t* src, const uint8_t* end, uint32_t* value)
+{
+	uint32_t result = 0;
+	for (uint32_t i = 0; i < VARINT_MAX_LEN && src + i < end; ++i) {
+		result |= (uint32_t)(src[i] & 0x7F) << (7 * i);
+		if ((src[i] & 0x80) == 0) {
+			*value = result;
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+#endif /* FUNVM_BYTE_ORDER_H */
\ No newline at end of file
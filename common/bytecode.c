@@ -1,7 +1,51 @@
 #include "bytecode.h"
 #include "memory.h"
+#include "container.h"
+#include "byte_order.h"
 
-// uint32_t* lines;
+const OpInfo opInfo[op_count] = {
+	[op_iconst]     = {"iconst",     opnd_const,  1, 0, 1, type_any, type_i32},
+	[op_iconstw]    = {"iconstw",    opnd_const,  2, 0, 1, type_any, type_i32},
+	[op_obj_str]    = {"obj_str",    opnd_object, 1, 0, 1, type_any, type_str},
+	[op_obj_strw]   = {"obj_strw",   opnd_object, 2, 0, 1, type_any, type_str},
+	[op_null]       = {"null",       opnd_none,   0, 0, 1, type_any, type_null},
+	[op_true]       = {"true",       opnd_none,   0, 0, 1, type_any, type_bool},
+	[op_false]      = {"false",      opnd_none,   0, 0, 1, type_any, type_bool},
+	[op_eq]         = {"eq",         opnd_none,   0, 2, 1, type_any, type_bool},
+	[op_gt]         = {"gt",         opnd_none,   0, 2, 1, type_any, type_bool},
+	[op_lt]         = {"lt",         opnd_none,   0, 2, 1, type_any, type_bool},
+	[op_add]        = {"add",        opnd_none,   0, 2, 1, type_any, type_any},
+	[op_sub]        = {"sub",        opnd_none,   0, 2, 1, type_any, type_i32},
+	[op_mul]        = {"mul",        opnd_none,   0, 2, 1, type_any, type_i32},
+	[op_div]        = {"div",        opnd_none,   0, 2, 1, type_any, type_i32},
+	[op_not]        = {"not",        opnd_none,   0, 1, 1, type_any, type_bool},
+	[op_negate]     = {"negate",     opnd_none,   0, 1, 1, type_any, type_i32},
+	[op_ret]        = {"ret",        opnd_none,   0, 1, 0, type_any, type_any},
+	[op_neq]        = {"neq",        opnd_none,   0, 2, 1, type_any, type_bool},
+	[op_ge]         = {"ge",         opnd_none,   0, 2, 1, type_any, type_bool},
+	[op_le]         = {"le",         opnd_none,   0, 2, 1, type_any, type_bool},
+	[op_zero]       = {"zero",       opnd_none,   0, 0, 1, type_any, type_i32},
+	[op_one]        = {"one",        opnd_none,   0, 0, 1, type_any, type_i32},
+	[op_push_i8]    = {"push_i8",    opnd_imm,    1, 0, 1, type_any, type_i32},
+	[op_push_i16]   = {"push_i16",   opnd_imm,    2, 0, 1, type_any, type_i32},
+	[op_add_i32]    = {"add_i32",    opnd_none,   0, 2, 1, type_i32, type_i32},
+	[op_sub_i32]    = {"sub_i32",    opnd_none,   0, 2, 1, type_i32, type_i32},
+	[op_mul_i32]    = {"mul_i32",    opnd_none,   0, 2, 1, type_i32, type_i32},
+	[op_gt_i32]     = {"gt_i32",     opnd_none,   0, 2, 1, type_i32, type_bool},
+	[op_lt_i32]     = {"lt_i32",     opnd_none,   0, 2, 1, type_i32, type_bool},
+	[op_ge_i32]     = {"ge_i32",     opnd_none,   0, 2, 1, type_i32, type_bool},
+	[op_le_i32]     = {"le_i32",     opnd_none,   0, 2, 1, type_i32, type_bool},
+	[op_concat_str] = {"concat_str", opnd_none,   0, 2, 1, type_str, type_str},
+	[op_concat]     = {"concat",     opnd_count,  1, 0, 1, type_str, type_str},
+	[op_shl]        = {"shl",        opnd_shift,  1, 1, 1, type_i32, type_i32},
+	[op_sar]        = {"sar",        opnd_shift,  1, 1, 1, type_i32, type_i32},
+	[op_mulhi]      = {"mulhi",      opnd_magic,  3, 1, 1, type_i32, type_i32},
+	[op_dup]        = {"dup",        opnd_none,   0, 1, 2, type_any, type_any},
+	[op_over]       = {"over",       opnd_none,   0, 2, 3, type_any, type_any},
+	[op_swap]       = {"swap",       opnd_none,   0, 2, 2, type_any, type_any},
+	[op_iconstl]    = {"iconstl",    opnd_const,  3, 0, 1, type_any, type_i32},
+	[op_obj_strl]   = {"obj_strl",   opnd_object, 3, 0, 1, type_any, type_str},
+};
 
 void
 initByteCode(ByteCode* bCode)
@@ -9,17 +53,42 @@ initByteCode(ByteCode* bCode)
 	bCode->count = 0;
 	bCode->capacity = 0;
 	bCode->code = NULL;
-	// lines = NULL;
+	bCode->strings = NULL;
+	bCode->storage = storage_owned;
+	bCode->image = NULL;
+	bCode->imageSize = 0;
+	bCode->maxStack = 0;
+	bCode->encoding = enc_bytes;
 	initConstPool(&bCode->constants);
+	initObjPool(&bCode->objects);
+	initLineTable(&bCode->lines);
 }
 
 void
 freeByteCode(ByteCode* bCode)
 {
-	FREE_ARRAY(uint8_t, bCode->code, bCode->capacity);
-	// FREE_ARRAY(uint32_t, lines, bCode->capacity);
+	FREE_ARRAY(ObjString*, bCode->strings, bCode->objects.count);
+	switch (bCode->storage) {
+		case storage_owned:
+			FREE_ARRAY(uint8_t, bCode->code, bCode->capacity);
+			freeObjPool(&bCode->objects);
+			freeLineTable(&bCode->lines);
+		break;
+		case storage_buffer:
+			FREE_ARRAY(uint8_t, bCode->image, bCode->imageSize);
+		break;
+		case storage_mapping:
+			unmapImage(bCode->image, bCode->imageSize);
+		break;
+		case storage_borrowed:
+		break;
+	}
+
+	// The index of the object pool is always built by the loader.
+	if (bCode->storage != storage_owned)
+		FREE_ARRAY(PoolString, bCode->objects.entries, bCode->objects.capacity);
+
 	freeConstPool(&bCode->constants);
-	freeObjPool(&bCode->objects);
 	initByteCode(bCode);
 }
 
@@ -33,13 +102,31 @@ writeByteCode(ByteCode* bCode, uint8_t byte, uint32_t line)
 		uint32_t oldCap = bCode->capacity;
 		bCode->capacity = GROW_CAPACITY(oldCap);
 		bCode->code     = GROW_ARRAY(uint8_t, bCode->code, oldCap, bCode->capacity);
-		// lines           = GROW_ARRAY(uint32_t, lines, oldCap, bCode->capacity);
 	} while(0);
 
-	// lines[bCode->count] = line;
+	writeLineTable(&bCode->lines, line);
 	bCode->code[bCode->count++] = byte;
 }
 
+/** Writes the shortest of the three forms of an instruction which takes a pool
+ * index: 'narrow' with an 8-bit one, 'wide' with 16 bits, 'wider' with 24 bits. */
+void
+writeIndexed(ByteCode* bCode, OpCode narrow, OpCode wide, OpCode wider, uint32_t idx, uint32_t line)
+{
+	if (idx <= UINT8_MAX) {
+		writeByteCode(bCode, narrow, line);
+	} else if (idx <= UINT16_MAX) {
+		writeByteCode(bCode, wide, line);
+		writeByteCode(bCode, (uint8_t)(idx >> 8), line);
+	} else {
+		writeByteCode(bCode, wider, line);
+		writeByteCode(bCode, (uint8_t)(idx >> 16), line);
+		writeByteCode(bCode, (uint8_t)(idx >> 8), line);
+	}
+
+	writeByteCode(bCode, (uint8_t)idx, line);
+}
+
 uint32_t
 addConstant(ByteCode* bCode, Value value)
 {
@@ -51,4 +138,68 @@ uint32_t
 addObject(ByteCode* bCode, void* obj)
 {
 	return writeObjPool(&bCode->objects, obj);
+}
+
+/** @returns uint32_t: the size in bytes of an instruction with the given (known) opcode. */
+uint32_t
+instructionSize(ByteCode* bCode, uint8_t opCode)
+{
+	return (bCode->encoding == enc_words) ? INSTRUCTION_WORD : 1 + opInfo[opCode].width;
+}
+
+/** @returns uint32_t: the operand of the instruction at 'offset', which must fit into the code. */
+uint32_t
+readOperand(ByteCode* bCode, uint32_t offset)
+{
+	if (bCode->encoding == enc_words)
+		return loadU32(&bCode->code[offset]) >> 8;
+
+	uint32_t operand = 0;
+	for (uint32_t i = 0; i < opInfo[bCode->code[offset]].width; ++i)
+		operand = (operand << 8) | bCode->code[offset + 1 + i];
+
+	return operand;
+}
+
+/**
+ * Re-encodes the (owned, byte-encoded) code into instruction words. Every operand
+ * fits into 24 bits, so the wide forms of the loads are replaced by the short ones.
+ */
+void
+encodeWords(ByteCode* bCode)
+{
+	uint8_t* code = bCode->code;
+	uint32_t count = bCode->count;
+	uint32_t capacity = bCode->capacity;
+	uint32_t* lines = ALLOCATE(uint32_t, count);
+
+	expandLineTable(&bCode->lines, lines, count);
+	freeLineTable(&bCode->lines);
+	bCode->code = NULL;
+	bCode->count = 0;
+	bCode->capacity = 0;
+
+	for (uint32_t offset = 0; offset < count;) {
+		uint8_t opCode = code[offset];
+		uint32_t operand = 0;
+		uint8_t word[INSTRUCTION_WORD];
+
+		for (uint32_t i = 0; i < opInfo[opCode].width; ++i)
+			operand = (operand << 8) | code[offset + 1 + i];
+
+		if (opCode == op_iconstw || opCode == op_iconstl)
+			opCode = op_iconst;
+		else if (opCode == op_obj_strw || opCode == op_obj_strl)
+			opCode = op_obj_str;
+
+		storeU32(word, opCode | (operand << 8));
+		for (uint32_t i = 0; i < INSTRUCTION_WORD; ++i)
+			writeByteCode(bCode, word[i], lines[offset]);
+
+		offset += 1 + opInfo[code[offset]].width;
+	}
+
+	bCode->encoding = enc_words;
+	FREE_ARRAY(uint8_t, code, capacity);
+	FREE_ARRAY(uint32_t, lines, count);
 }
\ No newline at end of file
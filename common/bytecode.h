@@ -4,6 +4,7 @@
 #include "common.h"
 #include "const_pool.h"
 #include "object_pool.h"
+#include "line_table.h"
 
 typedef enum {
 	op_iconst,
@@ -23,22 +24,112 @@ typedef enum {
 	op_not,
 	op_negate,
 	op_ret,
+	op_neq,
+	op_ge,
+	op_le,
+	op_zero,
+	op_one,
+	op_push_i8,
+	op_push_i16,
+	op_add_i32,
+	op_sub_i32,
+	op_mul_i32,
+	op_gt_i32,
+	op_lt_i32,
+	op_ge_i32,
+	op_le_i32,
+	op_concat_str,
+	op_concat,
+	op_shl,
+	op_sar,
+	op_mulhi,
+	op_dup,
+	op_over,
+	op_swap,
+	op_iconstl,
+	op_obj_strl,
+	op_count,	/* Not an instruction: the number of opcodes. */
 } OpCode;
 
+typedef enum {
+	opnd_none,
+	opnd_const,		/* <! index into the constant pool. */
+	opnd_object,	/* <! index into the object pool. */
+	opnd_imm,		/* <! signed integer value. */
+	opnd_count,		/* <! number of stack values the instruction consumes. */
+	opnd_shift,		/* <! shift amount, 1 to 31. */
+	opnd_magic,		/* <! u16 index of a constant multiplier | u8 shift amount and MAGIC_ADD. */
+} OperandKind;
+
+/* The low bits of the last operand byte of 'mulhi' are the shift amount, the flag
+ * tells whether the dividend is added to the high half of the product. */
+#define MAGIC_SHIFT	0x1F
+#define MAGIC_ADD	0x80
+
+/* Types of stack values as far as they are known before the code runs. */
+typedef enum {
+	type_any,	/* <! not known, the instruction using the value checks it at run time. */
+	type_null,
+	type_bool,
+	type_i32,
+	type_str,
+} StaticType;
+
+/* Static description of an instruction, used by the tools which inspect bytecode. */
+typedef struct {
+	const char* name;
+	OperandKind operand;
+	uint8_t     width;	/* <! size of the operand in bytes, big-endian. */
+	uint8_t     pops;	/* <! number of stack values the instruction consumes, see also opnd_count. */
+	uint8_t     pushes;	/* <! number of stack values the instruction produces. */
+	StaticType  takes;	/* <! type every consumed value must have, the instruction doesn't check it. */
+	StaticType  yields;	/* <! type of the produced value, unless the instruction fails. */
+} OpInfo;
+
+extern const OpInfo opInfo[op_count];
+
+/* Pools are indexed by 24-bit operands at most. */
+#define MAX_POOL_INDEX	0xFFFFFF
+
+/* How the instructions are laid out in the code. */
+typedef enum {
+	enc_bytes,	/* <! opcode byte followed by 'width' operand bytes, big-endian. */
+	enc_words,	/* <! little-endian 32-bit words: opcode in the low byte, operand in the high 24 bits. */
+} Encoding;
+
+#define INSTRUCTION_WORD	4
+
+/* Who owns the memory the code, the object pool and the line table live in. */
+typedef enum {
+	storage_owned,		/* <! each of them is an allocation of its own. */
+	storage_buffer,		/* <! they point into 'image', an allocation owned by the bytecode. */
+	storage_mapping,	/* <! they point into 'image', a file mapping owned by the bytecode. */
+	storage_borrowed,	/* <! they point into memory of someone else, e.g. an open archive. */
+} StorageKind;
+
 typedef struct {
 	uint32_t count;
 	uint32_t capacity;
 	uint8_t* code;
 	ConstPool constants;
 	ObjPool objects;
+	LineTable lines;
+	ObjString** strings;	/* <! the object pool resolved into interned strings, built by the VM. */
+	StorageKind storage;
+	uint8_t* image;
+	uint32_t imageSize;
+	uint32_t maxStack;	/* <! stack slots needed to run the code, set by the verifier. */
+	Encoding encoding;
 } ByteCode;
 
-extern uint32_t* lines;
-
 void initByteCode(ByteCode* bCode);
 void freeByteCode(ByteCode* bCode);
 void writeByteCode(ByteCode* bCode, uint8_t byte, uint32_t line);
+void writeIndexed(ByteCode* bCode, OpCode narrow, OpCode wide, OpCode wider, uint32_t idx, uint32_t line);
 uint32_t addConstant(ByteCode* bCode, Value value);
 uint32_t addObject(ByteCode* bCode, void* obj);
+uint32_t instructionSize(ByteCode* bCode, uint8_t opCode);
+uint32_t readOperand(ByteCode* bCode, uint32_t offset);
+void encodeWords(ByteCode* bCode);
 
 #endif /* FUNVM_BYTECODE_H */
\ No newline at end of file
@@ -31,3 +31,99 @@ writeConstPool(ConstPool* cPool, Value value)
 
 	cPool->values[cPool->count++] = value;
 }
+
+
+void
+initConstIndex(ConstIndex* index)
+{
+	index->capacity = 0;
+	index->shift = 32;
+	index->slots = NULL;
+}
+
+void
+freeConstIndex(ConstIndex* index)
+{
+	FREE_ARRAY(uint32_t, index->slots, index->capacity);
+	initConstIndex(index);
+}
+
+/* Fibonacci hashing: the slot is made of the top bits of the product, which depend
+ * on every bit of the value, so even constants that differ only high up spread out. */
+static uint32_t
+hashConst(ConstIndex* index, Value value)
+{
+	uint32_t key = IS_NUM(value) ? (uint32_t)NUM_UNPACK(value) : value.type;
+	return (key * 2654435769u) >> index->shift;
+}
+
+static void
+insertConst(ConstIndex* index, ConstPool* cPool, uint32_t idx)
+{
+	uint32_t slot = hashConst(index, cPool->values[idx]);
+	while (index->slots[slot] != 0)
+		slot = (slot + 1) & (index->capacity - 1);
+
+	index->slots[slot] = idx + 1;
+}
+
+static void
+growConstIndex(ConstIndex* index, ConstPool* cPool)
+{
+	if (index->capacity >= 2 * (cPool->count + 1))
+		return;
+
+	FREE_ARRAY(uint32_t, index->slots, index->capacity);
+	index->capacity = (index->capacity == 0) ? 16 : index->capacity * 2;
+	index->shift = (index->capacity == 16) ? 28 : index->shift - 1;
+	index->slots = ALLOCATE(uint32_t, index->capacity);
+	memset(index->slots, 0, sizeof(uint32_t) * index->capacity);
+
+	for (uint32_t i = 0; i < cPool->count; ++i)
+		insertConst(index, cPool, i);
+}
+
+/** @returns uint32_t: the slot of 'value' in the index, or the empty one it would take. */
+static uint32_t
+probeConst(ConstIndex* index, ConstPool* cPool, Value value)
+{
+	uint32_t slot = hashConst(index, value);
+	while (index->slots[slot] != 0 && !valuesEqual(cPool->values[index->slots[slot] - 1], value))
+		slot = (slot + 1) & (index->capacity - 1);
+
+	return slot;
+}
+
+/**
+ * Looks 'value' up in the pool, which must have gained all its values through
+ * internConst(), without adding it.
+ * @returns uint32_t: the index 'value' has, or would get, in the pool.
+ */
+uint32_t
+findConst(ConstIndex* index, ConstPool* cPool, Value value)
+{
+	if (index->capacity == 0)
+		return cPool->count;
+
+	uint32_t slot = probeConst(index, cPool, value);
+	return (index->slots[slot] != 0) ? index->slots[slot] - 1 : cPool->count;
+}
+
+/**
+ * Looks 'value' up in the pool, which must have gained all its values through
+ * this function, and appends it if it's not there yet.
+ * @returns uint32_t: the index of the value in the pool.
+ */
+uint32_t
+internConst(ConstIndex* index, ConstPool* cPool, Value value)
+{
+	growConstIndex(index, cPool);
+
+	uint32_t slot = probeConst(index, cPool, value);
+	if (index->slots[slot] != 0)
+		return index->slots[slot] - 1;
+
+	writeConstPool(cPool, value);
+	index->slots[slot] = cPool->count;
+	return cPool->count - 1;
+}
\ No newline at end of file
@@ -10,8 +10,20 @@ typedef struct {
 	Value* values;
 } ConstPool;
 
+/* Open-addressing index over the values of a constant pool, for deduplication. */
+typedef struct {
+	uint32_t  capacity;	/* <! power of two, at least twice the number of constants. */
+	uint32_t  shift;	/* <! 32 - log2(capacity), drops all but the top bits of a hash. */
+	uint32_t* slots;	/* <! index of a constant plus one, or 0 if the slot is empty. */
+} ConstIndex;
+
 void initConstPool(ConstPool* cPool);
 void freeConstPool(ConstPool* cPool);
 void writeConstPool(ConstPool* cPool, Value value);
 
+void initConstIndex(ConstIndex* index);
+void freeConstIndex(ConstIndex* index);
+uint32_t findConst(ConstIndex* index, ConstPool* cPool, Value value);
+uint32_t internConst(ConstIndex* index, ConstPool* cPool, Value value);
+
 #endif /* FUNVM_CONST_POOL_H */
\ No newline at end of file
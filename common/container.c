@@ -0,0 +1,579 @@
+#include "container.h"
+#include "memory.h"
+#include "byte_order.h"
+#include <assert.h>
+
+#if defined(FUNVM_HAS_MMAP)
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#define FNV_PRIME				16777619u	// 0x01000193
+#define ALIGN_UP(value, align)	(((value) + (align) - 1) & ~((align) - 1))
+#define TEMP_FILE_ATTEMPTS		64	/* <! names tried before createFile() gives up. */
+
+uint32_t
+fvbChecksum(uint32_t hash, const uint8_t* bytes, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; ++i) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static void
+encodeHeader(uint8_t* buf, const char* magic, FvbHeader* header)
+{
+	memset(buf, 0, FVB_HEADER_SIZE);
+	memcpy(buf, magic, 4);
+	storeU16(buf + 4,  header->major);
+	storeU16(buf + 6,  header->minor);
+	storeU32(buf + 8,  header->flags);
+	storeU32(buf + 12, header->fileSize);
+	storeU32(buf + 16, header->sectionCount);
+	storeU32(buf + 20, header->tableOffset);
+	storeU32(buf + 24, header->checksum);
+}
+
+static void
+decodeHeader(const uint8_t* buf, FvbHeader* header)
+{
+	header->major        = loadU16(buf + 4);
+	header->minor        = loadU16(buf + 6);
+	header->flags        = loadU32(buf + 8);
+	header->fileSize     = loadU32(buf + 12);
+	header->sectionCount = loadU32(buf + 16);
+	header->tableOffset  = loadU32(buf + 20);
+	header->checksum     = loadU32(buf + 24);
+}
+
+static void
+encodeSection(uint8_t* buf, FvbSection* section)
+{
+	storeU32(buf,      section->kind);
+	storeU32(buf + 4,  section->offset);
+	storeU32(buf + 8,  section->size);
+	storeU32(buf + 12, section->checksum);
+}
+
+static void
+decodeSection(const uint8_t* buf, FvbSection* section)
+{
+	section->kind     = loadU32(buf);
+	section->offset   = loadU32(buf + 4);
+	section->size     = loadU32(buf + 8);
+	section->checksum = loadU32(buf + 12);
+}
+
+/* ------------------------------- Writer ------------------------------- */
+
+void
+putBytes(ContainerWriter* writer, const void* bytes, uint32_t length)
+{
+	if (length == 0)
+		return;
+
+	fwrite(bytes, sizeof(uint8_t), length, writer->file);
+	writer->hash   = fvbChecksum(writer->hash, bytes, length);
+	writer->record = fvbChecksum(writer->record, bytes, length);
+	writer->pos   += length;
+}
+
+void
+putVarint(ContainerWriter* writer, uint32_t value)
+{
+	uint8_t buf[VARINT_MAX_LEN];
+	putBytes(writer, buf, storeVarint(buf, value));
+}
+
+void
+putU32(ContainerWriter* writer, uint32_t value)
+{
+	uint8_t buf[sizeof(uint32_t)];
+	storeU32(buf, value);
+	putBytes(writer, buf, sizeof(uint32_t));
+}
+
+/** Writes zero bytes which aren't covered by any checksum. */
+static void
+putPadding(ContainerWriter* writer, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; ++i)
+		fputc(0, writer->file);
+
+	writer->pos += length;
+}
+
+/**
+ * Creates the file at 'path' and reserves room for the header and a table of
+ * 'sectionCount' sections, which are written by endContainer(). Exactly that many
+ * sections have to be written.
+ * @returns bool: false if the file couldn't be created.
+ */
+bool
+beginContainer(ContainerWriter* writer, const char* path, uint32_t sectionCount)
+{
+	if (sectionCount > FVB_MAX_SECTIONS) {
+		fprintf(stderr, "Binary file '%s' can't have %u sections.\n", path, sectionCount);
+		return false;
+	}
+
+	writer->file = createFile(path, writer->tempPath, sizeof(writer->tempPath));
+	if (NULL == writer->file) {
+		fprintf(stderr, "Couldn't create binary file '%s'.\n", path);
+		return false;
+	}
+
+	writer->pos = 0;
+	writer->record = FVB_CHECKSUM_SEED;
+	writer->sectionCount = 0;
+	writer->reserved = sectionCount;
+	putPadding(writer, FVB_HEADER_SIZE + sectionCount * FVB_SECTION_SIZE);
+	return true;
+}
+
+/* Starts the next section at an aligned offset. The table has no room for more
+ * sections than beginContainer() reserved. */
+void
+beginSection(ContainerWriter* writer, SectionKind kind)
+{
+	assert(writer->sectionCount < writer->reserved);
+	FvbSection* section = &writer->sections[writer->sectionCount];
+
+	putPadding(writer, ALIGN_UP(writer->pos, FVB_SECTION_ALIGN) - writer->pos);
+	section->kind   = kind;
+	section->offset = writer->pos;
+	writer->hash    = FVB_CHECKSUM_SEED;
+}
+
+void
+endSection(ContainerWriter* writer)
+{
+	FvbSection* section = &writer->sections[writer->sectionCount++];
+	section->size     = writer->pos - section->offset;
+	section->checksum = writer->hash;
+}
+
+/**
+ * Writes the header and the section table and closes the file.
+ * @returns bool: false if anything failed to be written.
+ */
+bool
+endContainer(ContainerWriter* writer, const char* path, const char* magic, uint16_t major, uint16_t minor)
+{
+	FvbHeader header;
+	uint8_t headerBuf[FVB_HEADER_SIZE];
+	uint8_t tableBuf[FVB_MAX_SECTIONS * FVB_SECTION_SIZE];
+	uint32_t tableSize = writer->sectionCount * FVB_SECTION_SIZE;
+	bool result = true;
+
+	// A section which was reserved but never written is a bug of the caller, too.
+	if (writer->sectionCount != writer->reserved) {
+		fprintf(stderr, "Binary file '%s' got %u of its %u sections.\n", path, writer->sectionCount, writer->reserved);
+		commitFile(writer->file, writer->tempPath, path, false);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < writer->sectionCount; ++i)
+		encodeSection(tableBuf + i * FVB_SECTION_SIZE, &writer->sections[i]);
+
+	header.major        = major;
+	header.minor        = minor;
+	header.flags        = 0;
+	header.fileSize     = writer->pos;
+	header.sectionCount = writer->sectionCount;
+	header.tableOffset  = FVB_HEADER_SIZE;
+	header.checksum     = fvbChecksum(FVB_CHECKSUM_SEED, tableBuf, tableSize);
+	encodeHeader(headerBuf, magic, &header);
+
+	rewind(writer->file);
+	fwrite(headerBuf, sizeof(uint8_t), sizeof(headerBuf), writer->file);
+	fwrite(tableBuf,  sizeof(uint8_t), tableSize, writer->file);
+
+	if (ferror(writer->file)) {
+		fprintf(stderr, "Couldn't write binary file '%s'.\n", path);
+		result = false;
+	}
+
+	if (!commitFile(writer->file, writer->tempPath, path, result) && result) {
+		fprintf(stderr, "Couldn't write binary file '%s'.\n", path);
+		result = false;
+	}
+
+	return result;
+}
+
+/**
+ * Creates the file which is to replace the one at 'path' as a temporary one next to
+ * it, its name is stored into 'tempPath'. Once commitFile() renames it over the
+ * target, whoever reads the old file, or executes it mapped, keeps its complete
+ * contents, and nobody sees the new one half written.
+ * @returns FILE*: the file open for writing, NULL if it can't be created.
+ */
+FILE*
+createFile(const char* path, char* tempPath, uint32_t size)
+{
+#if defined(FUNVM_HAS_MMAP)
+	// Unlike mkstemp(), which makes the file private to its owner, the file gets the
+	// permissions fopen() would give it: the umask applies. O_EXCL keeps the name unique.
+	static _Thread_local uint32_t serial = 0;
+	int fd = -1;
+
+	for (uint32_t attempt = 0; fd < 0 && attempt < TEMP_FILE_ATTEMPTS; ++attempt) {
+		if (snprintf(tempPath, size, "%s.%ld.%u", path, (long)getpid(), serial++) >= (int)size)
+			return NULL;
+
+		fd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL, 0666);
+		if (fd < 0 && errno != EEXIST)
+			return NULL;
+	}
+
+	if (fd < 0)
+		return NULL;
+
+	FILE* file = fdopen(fd, "wb");
+	if (NULL == file) {
+		close(fd);
+		remove(tempPath);
+	}
+
+	return file;
+#else
+	// No temporary files where the names aren't known to be unique.
+	if (snprintf(tempPath, size, "%s", path) >= (int)size)
+		return NULL;
+
+	return fopen(path, "wb");
+#endif
+}
+
+/**
+ * Closes the file made by createFile() and, if 'result' is true, puts it in place
+ * of the one at 'path'. It's removed otherwise.
+ * @returns bool: false if it couldn't be closed or renamed.
+ */
+bool
+commitFile(FILE* file, const char* tempPath, const char* path, bool result)
+{
+	result = (fclose(file) == 0) && result;
+	if (strcmp(tempPath, path) == 0)
+		return result;
+
+	if (result && rename(tempPath, path) == 0)
+		return true;
+
+	remove(tempPath);
+	return false;
+}
+
+/* ------------------------------- Reader ------------------------------- */
+
+void
+containerError(Container* container, const char* error)
+{
+	if (!container->quiet)
+		fprintf(stderr, "Binary file '%s' %s.\n", container->path, error);
+}
+
+static const char*
+parseHeader(Container* container, const uint8_t* headerBuf, const char* magic, uint16_t major)
+{
+	FvbHeader* header = &container->header;
+
+	if (memcmp(headerBuf, magic, 4) != 0)
+		return "isn't a FunVM binary of the expected kind";
+
+	decodeHeader(headerBuf, header);
+	if (header->major != major)
+		return "was built for an unsupported version of FunVM";
+
+	if (header->fileSize != container->size)
+		return "is truncated";
+
+	if (header->sectionCount > FVB_MAX_SECTIONS || header->tableOffset < FVB_HEADER_SIZE ||
+		header->tableOffset > container->size ||
+		header->sectionCount * FVB_SECTION_SIZE > container->size - header->tableOffset)
+		return "has a corrupted section table";
+
+	return NULL;
+}
+
+static const char*
+parseTable(Container* container, const uint8_t* tableBuf)
+{
+	FvbHeader* header  = &container->header;
+	uint32_t tableSize = header->sectionCount * FVB_SECTION_SIZE;
+	uint32_t tableEnd  = header->tableOffset + tableSize;
+	uint32_t seen = 0;
+
+	if (fvbChecksum(FVB_CHECKSUM_SEED, tableBuf, tableSize) != header->checksum)
+		return "has a corrupted section table";
+
+	for (uint32_t i = 0; i < header->sectionCount; ++i) {
+		FvbSection* section = &container->sections[i];
+		decodeSection(tableBuf + i * FVB_SECTION_SIZE, section);
+
+		if (section->offset < tableEnd || section->offset % FVB_SECTION_ALIGN != 0 ||
+			section->offset > header->fileSize ||
+			section->size > header->fileSize - section->offset)
+			return "has a corrupted section table";
+
+		// Each kind of section may appear only once.
+		if (section->kind < 32) {
+			if (seen & (1u << section->kind))
+				return "has a corrupted section table";
+
+			seen |= 1u << section->kind;
+		}
+	}
+
+	return NULL;
+}
+
+static const char*
+readLayout(Container* container, const char* magic, uint16_t major)
+{
+	uint8_t headerBuf[FVB_HEADER_SIZE];
+	uint8_t tableBuf[FVB_MAX_SECTIONS * FVB_SECTION_SIZE];
+	const char* error;
+
+	fseek(container->file, 0L, SEEK_END);
+	container->size = (uint32_t)ftell(container->file);
+	rewind(container->file);
+
+	if (fread(headerBuf, sizeof(uint8_t), FVB_HEADER_SIZE, container->file) < FVB_HEADER_SIZE)
+		return "isn't a FunVM binary of the expected kind";
+
+	if ((error = parseHeader(container, headerBuf, magic, major)) != NULL)
+		return error;
+
+	uint32_t tableSize = container->header.sectionCount * FVB_SECTION_SIZE;
+	fseek(container->file, container->header.tableOffset, SEEK_SET);
+	if (fread(tableBuf, sizeof(uint8_t), tableSize, container->file) < tableSize)
+		return "has a corrupted section table";
+
+	return parseTable(container, tableBuf);
+}
+
+#if defined(FUNVM_HAS_MMAP)
+
+/**
+ * Maps the whole file at 'path' read-only. An empty file has no mapping, 'image'
+ * is set to NULL.
+ * @returns const char*: NULL on success, otherwise why the file couldn't be mapped.
+ */
+const char*
+mapFile(const char* path, uint8_t** image, uint32_t* size)
+{
+	struct stat st;
+
+	*image = NULL;
+	*size  = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return "couldn't be opened";
+
+	if (fstat(fd, &st) != 0 || st.st_size > UINT32_MAX) {
+		close(fd);
+		return "is too big";
+	}
+
+	*size = (uint32_t)st.st_size;
+	if (*size > 0)
+		*image = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+
+	close(fd);	// The mapping keeps the file referenced.
+	if (*image == MAP_FAILED) {
+		*image = NULL;
+		return "couldn't be mapped";
+	}
+
+	return NULL;
+}
+
+static const char*
+mapLayout(Container* container, const char* magic, uint16_t major)
+{
+	const char* error = mapFile(container->path, &container->image, &container->size);
+	if (error != NULL)
+		return error;
+
+	if (container->size < FVB_HEADER_SIZE)
+		return "isn't a FunVM binary of the expected kind";
+
+	if ((error = parseHeader(container, container->image, magic, major)) != NULL)
+		return error;
+
+	return parseTable(container, container->image + container->header.tableOffset);
+}
+
+void
+unmapImage(uint8_t* image, uint32_t size)
+{
+	munmap(image, size);
+}
+
+#else
+
+const char*
+mapFile(const char* path, uint8_t** image, uint32_t* size)
+{
+	return "can't be mapped on this platform";
+}
+
+static const char*
+mapLayout(Container* container, const char* magic, uint16_t major)
+{
+	return "can't be mapped on this platform";
+}
+
+void
+unmapImage(uint8_t* image, uint32_t size)
+{
+	// Nothing to do, containers are never mapped on this platform.
+}
+
+#endif /* FUNVM_HAS_MMAP */
+
+static bool
+openLayout(Container* container, const char* path, const char* magic, uint16_t major, bool mapped, bool quiet)
+{
+	const char* error;
+
+	container->path  = path;
+	container->file  = NULL;
+	container->image = NULL;
+	container->size  = 0;
+	container->quiet = quiet;
+
+#if defined(FUNVM_HAS_MMAP)
+	if (mapped) {
+		error = mapLayout(container, magic, major);
+	} else
+#endif
+	{
+		container->file = fopen(path, "rb");
+		if (NULL == container->file) {
+			if (!quiet)
+				fprintf(stderr, "Couldn't open binary file '%s'.\n", path);
+			return false;
+		}
+
+		error = readLayout(container, magic, major);
+	}
+
+	if (error != NULL) {
+		containerError(container, error);
+		closeContainer(container);
+		if (container->image != NULL)
+			unmapImage(container->image, container->size);
+		container->image = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Opens the container at 'path' and validates its header and section table. If
+ * 'mapped' is set (and supported), the whole file is mapped read-only, otherwise
+ * the file stays open and the sections are read on demand.
+ * @returns bool: false if the file can't be opened or isn't a valid container.
+ */
+bool
+openContainer(Container* container, const char* path, const char* magic, uint16_t major, bool mapped)
+{
+	return openLayout(container, path, magic, major, mapped, false);
+}
+
+/**
+ * Same as openContainer() without mapping, for callers which merely check whether a
+ * valid container is there: a missing or invalid one isn't reported.
+ * @returns bool: false if the file can't be opened or isn't a valid container.
+ */
+bool
+probeContainer(Container* container, const char* path, const char* magic, uint16_t major)
+{
+	return openLayout(container, path, magic, major, false, true);
+}
+
+/** Closes the file of a read container. The image of a mapped one is left to the
+ * caller, the loaded data may keep pointing into it. */
+void
+closeContainer(Container* container)
+{
+	if (container->file != NULL)
+		fclose(container->file);
+
+	container->file = NULL;
+}
+
+FvbSection*
+findSection(Container* container, SectionKind kind)
+{
+	for (uint32_t i = 0; i < container->header.sectionCount; ++i) {
+		if (container->sections[i].kind == kind)
+			return &container->sections[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Provides 'size' bytes of the container at 'offset' in 'data': a pointer into the
+ * image of a mapped container or a fresh allocation, released by releaseRange().
+ * @returns bool: false if the data couldn't be read.
+ */
+bool
+fetchRange(Container* container, uint32_t offset, uint32_t size, uint8_t** data)
+{
+	*data = NULL;
+	if (offset > container->size || size > container->size - offset)
+		return false;
+
+	if (container->image != NULL) {
+		*data = container->image + offset;
+		return true;
+	}
+
+	if (size == 0)
+		return true;
+
+	*data = ALLOCATE(uint8_t, size);
+	fseek(container->file, offset, SEEK_SET);
+	if (fread(*data, sizeof(uint8_t), size, container->file) < size) {
+		FREE_ARRAY(uint8_t, *data, size);
+		*data = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/** Same as fetchRange() for a whole section, whose checksum is verified. */
+bool
+fetchSection(Container* container, FvbSection* section, uint8_t** data)
+{
+	if (!fetchRange(container, section->offset, section->size, data))
+		return false;
+
+	if (fvbChecksum(FVB_CHECKSUM_SEED, *data, section->size) != section->checksum) {
+		releaseRange(container, *data, section->size);
+		*data = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void
+releaseRange(Container* container, uint8_t* data, uint32_t size)
+{
+	if (container->image == NULL)
+		FREE_ARRAY(uint8_t, data, size);
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef FUNVM_CONTAINER_H
+#define FUNVM_CONTAINER_H
+
+#include "common.h"
+
+/* Layout shared by compiled modules (.fvb) and module archives (.fva).
+ * All fields are little-endian.
+ *
+ *   +--------------------+  0
+ *   | header             |  FVB_HEADER_SIZE bytes
+ *   +--------------------+  header.tableOffset
+ *   | section table      |  header.sectionCount * FVB_SECTION_SIZE bytes
+ *   +--------------------+  aligned to FVB_SECTION_ALIGN
+ *   | section 0 data     |
+ *   +--------------------+  aligned to FVB_SECTION_ALIGN
+ *   | ...                |
+ *   +--------------------+  header.fileSize
+ *
+ * Header:
+ *   u8  magic[4]      tells modules and archives apart.
+ *   u16 major         bumped on incompatible changes, a reader rejects any other major.
+ *   u16 minor         bumped on compatible additions (e.g. new optional sections).
+ *   u32 flags
+ *   u32 fileSize
+ *   u32 sectionCount
+ *   u32 tableOffset
+ *   u32 checksum      FNV-1a of the section table.
+ *   u32 reserved
+ *
+ * Section table entry:
+ *   u32 kind          one of SectionKind, unknown kinds are skipped.
+ *   u32 offset        from the beginning of the file.
+ *   u32 size          in bytes, excluding the alignment padding.
+ *   u32 checksum      FNV-1a of the section data. */
+
+#define FVB_HEADER_SIZE     32
+#define FVB_SECTION_SIZE    16
+#define FVB_SECTION_ALIGN   8
+#define FVB_MAX_SECTIONS    16
+#define FVB_CHECKSUM_SEED   2166136261u	// 0x811C9DC5
+#define FVB_MAX_PATH        512
+
+/* Containers are executed in place only where mmap() exists and the host byte order
+ * matches the file's one, otherwise they are read into memory. */
+#if (defined(__unix__) || defined(__APPLE__)) && \
+	defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#	define FUNVM_HAS_MMAP
+#endif
+
+typedef enum {
+	// Sections of a module.
+	sec_code = 1,
+	sec_constants,
+	sec_strings,
+	sec_lines,
+	sec_code_words,
+	sec_build_key,
+	// Sections of an archive.
+	sec_index = 16,
+	sec_shared_strings,
+	sec_modules,
+} SectionKind;
+
+typedef struct {
+	uint16_t major;
+	uint16_t minor;
+	uint32_t flags;
+	uint32_t fileSize;
+	uint32_t sectionCount;
+	uint32_t tableOffset;
+	uint32_t checksum;
+} FvbHeader;
+
+typedef struct {
+	uint32_t kind;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t checksum;
+} FvbSection;
+
+typedef struct {
+	FILE*      file;
+	char       tempPath[FVB_MAX_PATH];	/* <! where the file is written, see createFile(). */
+	uint32_t   pos;		/* <! current offset within the file. */
+	uint32_t   hash;	/* <! running checksum of the section being written. */
+	uint32_t   record;	/* <! running checksum of a part of the section, reset by the caller. */
+	uint32_t   sectionCount;	/* <! sections written so far. */
+	uint32_t   reserved;	/* <! sections the table has room for, see beginContainer(). */
+	FvbSection sections[FVB_MAX_SECTIONS];
+} ContainerWriter;
+
+typedef struct {
+	const char* path;
+	FvbHeader   header;
+	FvbSection  sections[FVB_MAX_SECTIONS];
+	FILE*       file;	/* <! open while the container is read section by section. */
+	uint8_t*    image;	/* <! the whole file, if the container is mapped. */
+	uint32_t    size;
+	bool        quiet;	/* <! errors aren't reported, see probeContainer(). */
+} Container;
+
+uint32_t fvbChecksum(uint32_t hash, const uint8_t* bytes, uint32_t length);
+
+bool beginContainer(ContainerWriter* writer, const char* path, uint32_t sectionCount);
+bool endContainer(ContainerWriter* writer, const char* path, const char* magic, uint16_t major, uint16_t minor);
+void beginSection(ContainerWriter* writer, SectionKind kind);
+void endSection(ContainerWriter* writer);
+void putBytes(ContainerWriter* writer, const void* bytes, uint32_t length);
+void putVarint(ContainerWriter* writer, uint32_t value);
+void putU32(ContainerWriter* writer, uint32_t value);
+
+bool openContainer(Container* container, const char* path, const char* magic, uint16_t major, bool mapped);
+bool probeContainer(Container* container, const char* path, const char* magic, uint16_t major);
+void closeContainer(Container* container);
+FvbSection* findSection(Container* container, SectionKind kind);
+bool fetchRange(Container* container, uint32_t offset, uint32_t size, uint8_t** data);
+bool fetchSection(Container* container, FvbSection* section, uint8_t** data);
+void releaseRange(Container* container, uint8_t* data, uint32_t size);
+void containerError(Container* container, const char* error);
+FILE* createFile(const char* path, char* tempPath, uint32_t size);
+bool commitFile(FILE* file, const char* tempPath, const char* path, bool result);
+const char* mapFile(const char* path, uint8_t** image, uint32_t* size);
+void unmapImage(uint8_t* image, uint32_t size);
+
+#endif /* FUNVM_CONTAINER_H */
\ No newline at end of file
@@ -72,7 +72,7 @@ adjustCapacity(Table* table, uint32_t capacity)
 	for (uint32_t i = 0; i < table->capacity; ++i) {
 		// get subsequent entry.
 		Entry* entry = &table->entries[i];
-		if (entry == NULL)
+		if (entry->key == NULL)
 			continue;
 		
 		// Get the reference to an appropriate place in hash table being resized.
@@ -9,8 +9,9 @@
 #define HEAP_GET_NEXT(arr)         		((block_t*)arr)->next
 #define ALLIGN4(value)         			(((value + 3) >> 2) << 2)
 
-uint8_t heap[HEAP_STATIC_SIZE] __attribute__ ((aligned (4)));
-static uint32_t heapBound;
+/* Each thread has a heap of its own, so they never contend for it. */
+_Thread_local uint8_t heap[HEAP_STATIC_SIZE] __attribute__ ((aligned (4)));
+static _Thread_local uint32_t heapBound;
 
 /**
  * Initializes heap storage.
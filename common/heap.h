@@ -16,6 +16,7 @@ struct block_t {
 	block_t* next;
 };
 
+/* Initializes the heap of the calling thread, which has to be done once per thread. */
 void  heapInit(void);
 void* heapAlloc(uint32_t size);
 void  heapFree(void* ptr);
@@ -0,0 +1,131 @@
+#include "memory.h"
+#include "line_table.h"
+#include "byte_order.h"
+
+void
+initLineTable(LineTable* table)
+{
+	table->size = 0;
+	table->capacity = 0;
+	table->runs = NULL;
+	table->prevLine = 0;
+	table->line = 0;
+	table->length = 0;
+}
+
+void
+freeLineTable(LineTable* table)
+{
+	FREE_ARRAY(uint8_t, table->runs, table->capacity);
+	initLineTable(table);
+}
+
+static void
+packRun(LineTable* table)
+{
+	do {
+		if (table->capacity >= table->size + 2 * VARINT_MAX_LEN)
+			break;
+
+		uint32_t oldCap = table->capacity;
+		table->capacity = GROW_CAPACITY(oldCap + 2 * VARINT_MAX_LEN);
+		table->runs     = GROW_ARRAY(uint8_t, table->runs, oldCap, table->capacity);
+	} while(0);
+
+	table->size += storeVarint(table->runs + table->size, table->length);
+	table->size += storeVarint(table->runs + table->size, ZIGZAG_ENCODE(table->line - table->prevLine));
+	table->prevLine = table->line;
+	table->length = 0;
+}
+
+/** Records the line of the next byte of code. */
+void
+writeLineTable(LineTable* table, uint32_t line)
+{
+	if (table->length > 0 && table->line == line) {
+		table->length++;
+		return;
+	}
+
+	closeLineTable(table);
+	table->line = line;
+	table->length = 1;
+}
+
+/** Packs the open run, once the code is complete. */
+void
+closeLineTable(LineTable* table)
+{
+	if (table->length > 0)
+		packRun(table);
+}
+
+/**
+ * Looks up the source line of the code byte at 'offset'.
+ * @returns uint32_t: the line or 0 if it's unknown.
+ */
+uint32_t
+getLine(LineTable* table, uint32_t offset)
+{
+	const uint8_t* pos = table->runs;
+	const uint8_t* end = table->runs + table->size;
+	uint32_t start = 0;
+	uint32_t line = 0;
+
+	while (pos < end) {
+		uint32_t length, delta, varLen;
+
+		if ((varLen = loadVarint(pos, end, &length)) == 0)
+			return 0;
+		pos += varLen;
+
+		if ((varLen = loadVarint(pos, end, &delta)) == 0)
+			return 0;
+		pos += varLen;
+
+		line += ZIGZAG_DECODE(delta);
+		if (offset - start < length)
+			return line;
+
+		start += length;
+	}
+
+	if (offset - start < table->length)
+		return table->line;
+
+	return 0;
+}
+
+
+/** Decodes the lines of the first 'count' bytes of code into 'lines' at once, for
+ * passes which rewrite or walk the whole code. Bytes of unknown lines get 0. */
+void
+expandLineTable(LineTable* table, uint32_t* lines, uint32_t count)
+{
+	const uint8_t* pos = table->runs;
+	const uint8_t* end = table->runs + table->size;
+	uint32_t offset = 0;
+	uint32_t line = 0;
+
+	while (pos < end && offset < count) {
+		uint32_t length, delta, varLen;
+
+		if ((varLen = loadVarint(pos, end, &length)) == 0)
+			break;
+		pos += varLen;
+
+		if ((varLen = loadVarint(pos, end, &delta)) == 0)
+			break;
+		pos += varLen;
+
+		line += ZIGZAG_DECODE(delta);
+		for (uint32_t i = 0; i < length && offset < count; ++i)
+			lines[offset++] = line;
+	}
+
+	for (uint32_t i = 0; i < table->length && offset < count; ++i)
+		lines[offset++] = table->line;
+
+	while (offset < count)
+		lines[offset++] = 0;
+}
\ No newline at end of file
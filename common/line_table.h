@@ -0,0 +1,27 @@
+#ifndef FUNVM_LINE_TABLE_H
+#define FUNVM_LINE_TABLE_H
+
+#include "common.h"
+
+/* Maps code offsets to source lines for error reporting. Consecutive bytes of code
+ * produced by the same line form a run, and runs are packed as
+ *   varint length | zigzag varint (line - line of the previous run)
+ * The most recent run stays open (unpacked) while the code is being written.
+ * The table is only decoded when an error has to be reported. */
+typedef struct {
+	uint32_t size;		/* <! number of bytes used in 'runs'. */
+	uint32_t capacity;
+	uint8_t* runs;
+	uint32_t prevLine;	/* <! line of the last packed run. */
+	uint32_t line;		/* <! line of the open run. */
+	uint32_t length;	/* <! length of the open run. */
+} LineTable;
+
+void initLineTable(LineTable* table);
+void freeLineTable(LineTable* table);
+void writeLineTable(LineTable* table, uint32_t line);
+void closeLineTable(LineTable* table);
+uint32_t getLine(LineTable* table, uint32_t offset);
+void expandLineTable(LineTable* table, uint32_t* lines, uint32_t count);
+
+#endif /* FUNVM_LINE_TABLE_H */
@@ -33,13 +33,19 @@ freeObject(Obj* object)
 	}
 }
 
+/** Frees every object of the list, e.g. the one a StringSet owns. */
 void
-freeObjects(void)
+freeObjectList(Obj* object)
 {
-	Obj* object = vm.objects;
 	while (object != NULL) {
 		Obj* next = object->next;
 		freeObject(object);
 		object = next;
 	}
+}
+
+void
+freeObjects(void)
+{
+	freeObjectList(vm.objects);
 }
\ No newline at end of file
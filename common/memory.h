@@ -2,6 +2,7 @@
 #define FUNVM_MEMORY_H
 
 #include "common.h"
+#include "value.h"
 
 #if defined(FUNVM_MEM_MANAGER)
 #	include "heap.h"
@@ -30,6 +31,7 @@
 	reallocate(ptr, sizeof(type) * (oldCap), 0)
 
 void* reallocate(void* ptr, size_t oldSize, size_t newSize);
+void freeObjectList(Obj* object);
 void freeObjects(void);
 
 #endif /* FUNVM_MEMORY_H */
\ No newline at end of file
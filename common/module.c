@@ -0,0 +1,267 @@
+#include "module.h"
+#include "memory.h"
+#include "byte_order.h"
+
+/* ------------------------------- Writer ------------------------------- */
+
+/** @returns uint32_t: the number of bytes putConstants() writes for the pool. */
+uint32_t
+constantsSize(ConstPool* cPool)
+{
+	uint8_t buf[VARINT_MAX_LEN];
+	uint32_t size;
+
+	if (cPool->count == 0)
+		return 0;
+
+	size = sizeof(uint8_t) + storeVarint(buf, cPool->count);
+	for (uint32_t i = 0; i < cPool->count; ++i)
+		size += storeVarint(buf, ZIGZAG_ENCODE(NUM_UNPACK(cPool->values[i])));
+
+	return size;
+}
+
+bool
+putConstants(ContainerWriter* writer, ConstPool* cPool)
+{
+	if (cPool->count == 0)
+		return true;
+
+	uint8_t type = val_num;
+	putBytes(writer, &type, sizeof(uint8_t));
+	putVarint(writer, cPool->count);
+
+	for (uint32_t i = 0; i < cPool->count; ++i) {
+		if (!IS_NUM(cPool->values[i])) {
+			fprintf(stderr, "Only numeric constants can be serialized.\n");
+			return false;
+		}
+
+		putVarint(writer, ZIGZAG_ENCODE(NUM_UNPACK(cPool->values[i])));
+	}
+
+	return true;
+}
+
+/**
+ * Writes the given bytecode into the file at 'path' in .fvb format, along with the
+ * key of the build which produced it, if there's one.
+ * @returns bool: false if the file couldn't be written.
+ */
+bool
+writeModule(const char* path, ByteCode* bCode, const BuildKey* key)
+{
+	ContainerWriter writer;
+	bool result;
+
+	if (!beginContainer(&writer, path, (key != NULL) ? 5 : 4))
+		return false;
+
+	beginSection(&writer, (bCode->encoding == enc_words) ? sec_code_words : sec_code);
+	putBytes(&writer, bCode->code, bCode->count);
+	endSection(&writer);
+
+	beginSection(&writer, sec_constants);
+	result = putConstants(&writer, &bCode->constants);
+	endSection(&writer);
+
+	beginSection(&writer, sec_strings);
+	putVarint(&writer, bCode->objects.count);
+	putBytes(&writer, bCode->objects.values, bCode->objects.size);
+	endSection(&writer);
+
+	closeLineTable(&bCode->lines);
+	beginSection(&writer, sec_lines);
+	putBytes(&writer, bCode->lines.runs, bCode->lines.size);
+	endSection(&writer);
+
+	if (key != NULL) {
+		beginSection(&writer, sec_build_key);
+		putU32(&writer, (uint32_t)key->sourceHash);
+		putU32(&writer, (uint32_t)(key->sourceHash >> 32));
+		putU32(&writer, key->sourceSize);
+		putU32(&writer, key->compiler);
+		putU32(&writer, key->options);
+		endSection(&writer);
+	}
+
+	return endContainer(&writer, path, FVB_MAGIC, FVB_VERSION_MAJOR, FVB_VERSION_MINOR) && result;
+}
+
+/* ------------------------------- Reader ------------------------------- */
+
+bool
+decodeConstants(const uint8_t* data, uint32_t size, ConstPool* cPool)
+{
+	const uint8_t* end = data + size;
+	const uint8_t* pos = data;
+
+	// The section is a sequence of typed arrays: u8 type | varint count | values
+	while (pos < end) {
+		uint8_t type = *pos++;
+		uint32_t count;
+		uint32_t varLen = loadVarint(pos, end, &count);
+
+		// Each value takes at least one byte, don't trust 'count' beyond that.
+		if (type != val_num || varLen == 0 || count > (uint32_t)(end - pos - varLen))
+			return false;
+
+		pos += varLen;
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t raw;
+			varLen = loadVarint(pos, end, &raw);
+			if (varLen == 0)
+				return false;
+
+			pos += varLen;
+			writeConstPool(cPool, NUM_PACK(ZIGZAG_DECODE(raw)));
+		}
+	}
+
+	return true;
+}
+
+/** Indexes the strings section, the pool keeps referencing 'data'. */
+static bool
+decodeStrings(uint8_t* data, uint32_t size, ObjPool* objPool)
+{
+	uint32_t count;
+	uint32_t varLen = loadVarint(data, data + size, &count);
+
+	objPool->values = data;
+	objPool->size   = size;
+	return varLen != 0 && indexObjPool(objPool, data + varLen, count);
+}
+
+/**
+ * Decodes the data of the given section into 'bCode'. The code, the strings and
+ * the lines keep referencing 'data'.
+ * @returns bool: false if the section is malformed.
+ */
+static bool
+loadSection(ByteCode* bCode, FvbSection* section, uint8_t* data)
+{
+	switch (section->kind) {
+		case sec_code:
+		case sec_code_words:
+			bCode->encoding = (section->kind == sec_code_words) ? enc_words : enc_bytes;
+			bCode->code     = data;
+			bCode->count    = section->size;
+			bCode->capacity = section->size;
+			return true;
+		case sec_constants:
+			return decodeConstants(data, section->size, &bCode->constants);
+		case sec_strings:
+			return decodeStrings(data, section->size, &bCode->objects);
+		case sec_lines:
+			// Decoded only when an error has to be reported.
+			bCode->lines.runs     = data;
+			bCode->lines.size     = section->size;
+			bCode->lines.capacity = section->size;
+			return true;
+		default:
+			return true;
+	}
+}
+
+/**
+ * Loads the .fvb file at 'path' into the given (initialized) bytecode. A read
+ * module gets every section in an allocation of its own, a mapped one executes its
+ * code and string data in place and the mapping is released by freeByteCode().
+ * @returns bool: false if the file can't be loaded or isn't a valid module.
+ */
+static bool
+loadModule(const char* path, ByteCode* bCode, bool mapped)
+{
+	Container container;
+	const char* error = NULL;
+
+	if (!openContainer(&container, path, FVB_MAGIC, FVB_VERSION_MAJOR, mapped))
+		return false;
+
+	if (container.image != NULL) {
+		bCode->storage   = storage_mapping;
+		bCode->image     = container.image;
+		bCode->imageSize = container.size;
+	}
+
+	bool bytes = (findSection(&container, sec_code) != NULL);
+	bool words = (findSection(&container, sec_code_words) != NULL);
+	if (!bytes && !words)
+		error = "has no code";
+	else if (bytes && words)
+		error = "has code in both encodings";
+
+	for (uint32_t i = 0; i < container.header.sectionCount && error == NULL; ++i) {
+		FvbSection* section = &container.sections[i];
+		uint8_t* data;
+
+		if (section->kind < sec_code || section->kind > sec_code_words)
+			continue; // An optional section added by a newer minor version.
+
+		if (!fetchSection(&container, section, &data)) {
+			error = "has a corrupted section";
+			break;
+		}
+
+		if (!loadSection(bCode, section, data))
+			error = "has a corrupted section";
+
+		// Everything but the constants is used right from the section data.
+		if (section->kind == sec_constants)
+			releaseRange(&container, data, section->size);
+	}
+
+	closeContainer(&container);
+
+	if (error != NULL) {
+		containerError(&container, error);
+		freeByteCode(bCode);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+readModule(const char* path, ByteCode* bCode)
+{
+	return loadModule(path, bCode, false);
+}
+
+/** Same as readModule(), but executes the module in place where mmap() is supported. */
+bool
+mapModule(const char* path, ByteCode* bCode)
+{
+	return loadModule(path, bCode, true);
+}
+
+/**
+ * Reads the key of the build which produced the module at 'path', without loading
+ * the module. A missing, invalid or outdated file isn't an error, it's just not
+ * built yet, so nothing is reported.
+ * @returns bool: false if there's no such module or it has no build key.
+ */
+bool
+readBuildKey(const char* path, BuildKey* key)
+{
+	Container container;
+	if (!probeContainer(&container, path, FVB_MAGIC, FVB_VERSION_MAJOR))
+		return false;
+
+	FvbSection* section = findSection(&container, sec_build_key);
+	uint8_t* data;
+	bool result = (section != NULL && section->size == BUILD_KEY_SIZE &&
+		fetchSection(&container, section, &data));
+
+	if (result) {
+		key->sourceHash = loadU32(data) | ((uint64_t)loadU32(data + 4) << 32);
+		key->sourceSize = loadU32(data + 8);
+		key->compiler   = loadU32(data + 12);
+		key->options    = loadU32(data + 16);
+		releaseRange(&container, data, section->size);
+	}
+
+	closeContainer(&container);
+	return result;
+}
\ No newline at end of file
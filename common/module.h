@@ -0,0 +1,44 @@
+#ifndef FUNVM_MODULE_H
+#define FUNVM_MODULE_H
+
+#include "common.h"
+#include "bytecode.h"
+#include "container.h"
+
+/* A compiled module (.fvb file) is a container (see container.h) with the magic
+ * "FVMB" and the following sections:
+ *   sec_code          raw instruction stream, 'size' bytes.
+ *   sec_constants     sequence of typed arrays: u8 type | varint count | values,
+ *                     the only type so far is val_num with zigzag varint values.
+ *   sec_strings       varint count | object pool entries (see object_pool.h).
+ *   sec_lines         packed line runs (see line_table.h), optional.
+ *   sec_code_words    instruction words (see Encoding in bytecode.h), 'size' bytes,
+ *                     instead of sec_code.
+ *   sec_build_key     u64 sourceHash | u32 sourceSize | u32 compiler | u32 options,
+ *                     see BuildKey, optional. */
+
+#define FVB_MAGIC           "FVMB"
+#define FVB_VERSION_MAJOR   2
+#define FVB_VERSION_MINOR   10
+
+#define BUILD_KEY_SIZE      20
+
+/* What a module was compiled from: the same source compiled by the same compiler
+ * with the same options gives the same module. */
+typedef struct {
+	uint64_t sourceHash;	/* <! FNV-1a of the source text. */
+	uint32_t sourceSize;
+	uint32_t compiler;		/* <! FVB major << 24 | FVB minor << 16 | COMPILER_REVISION. */
+	uint32_t options;		/* <! compiler options which change the module. */
+} BuildKey;
+
+bool writeModule(const char* path, ByteCode* bCode, const BuildKey* key);
+bool readBuildKey(const char* path, BuildKey* key);
+bool readModule(const char* path, ByteCode* bCode);
+bool mapModule(const char* path, ByteCode* bCode);
+
+uint32_t constantsSize(ConstPool* cPool);
+bool putConstants(ContainerWriter* writer, ConstPool* cPool);
+bool decodeConstants(const uint8_t* data, uint32_t size, ConstPool* cPool);
+
+#endif /* FUNVM_MODULE_H */
\ No newline at end of file
@@ -5,16 +5,16 @@
 #include "hash_table.h"
 #include "globals.h"
 
-#define ALLOCATE_OBJ(objStruct, objType)  \
-	(objStruct*)allocateObject(sizeof(objStruct), objType)
+#define ALLOCATE_OBJ(objects, objStruct, objType)  \
+	(objStruct*)allocateObject(objects, sizeof(objStruct), objType)
 
 static Obj*
-allocateObject(size_t size, ObjType objType)
+allocateObject(Obj** objects, size_t size, ObjType objType)
 {
 	Obj* object  = (Obj*)reallocate(NULL, 0 , size);
 	object->type = objType;
-	object->next = vm.objects;
-	vm.objects   = object;
+	object->next = *objects;
+	*objects     = object;
 	
 	return object;
 }
@@ -32,45 +32,71 @@ hashString(const char* key, uint32_t length)
 }
 
 static ObjString*
-allocateString(const char* heapChars, uint32_t length, uint32_t hash)
+allocateString(StringSet* set, const char* heapChars, uint32_t length, uint32_t hash)
 {
-	ObjString* string = ALLOCATE_OBJ(ObjString, obj_string);
+	ObjString* string = ALLOCATE_OBJ(set->objects, ObjString, obj_string);
 	string->len   = length;
 	string->chars = heapChars;
 	string->hash  = hash;
-	tableSet(&vm.strings, string, NULL_PACK());
+	tableSet(set->strings, string, NULL_PACK());
 	return string;
 }
 
+/** Same as copyHashedString(), interning into the given set rather than the VM's. */
 ObjString*
-copyString(const char* chars, uint32_t length)
+internHashed(StringSet* set, const char* chars, uint32_t length, uint32_t hash)
 {
-	uint32_t hash = hashString(chars, length);
-	
-	// Look up a given string in 'interns table' of the VM.
-	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+	ObjString* interned = tableFindString(set->strings, chars, length, hash);
 	if (interned != NULL)
 		return interned;
 
 	char* heapChars = ALLOCATE(char, length + 1);
 	memcpy(heapChars, chars, length);
 	heapChars[length] = '\0';
-	return allocateString(heapChars, length, hash);
+	return allocateString(set, heapChars, length, hash);
 }
 
+/** Same as copyString(), interning into the given set rather than the VM's. */
 ObjString*
-takeString(const char* chars, uint32_t length)
+internCopy(StringSet* set, const char* chars, uint32_t length)
+{
+	return internHashed(set, chars, length, hashString(chars, length));
+}
+
+/** Same as takeString(), interning into the given set rather than the VM's. */
+ObjString*
+internTake(StringSet* set, const char* chars, uint32_t length)
 {
 	uint32_t hash = hashString(chars, length);
-	
-	// Look up a given string in 'interns table' of the VM.
-	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
+	ObjString* interned = tableFindString(set->strings, chars, length, hash);
 	if (interned != NULL) {
 		FREE_ARRAY(const char, (void*)chars, length + 1);
 		return interned;
 	}
 
-	return allocateString(chars, length, hash);
+	return allocateString(set, chars, length, hash);
+}
+
+ObjString*
+copyString(const char* chars, uint32_t length)
+{
+	return copyHashedString(chars, length, hashString(chars, length));
+}
+
+/** Same as copyString(), for callers which already know the hash of the string. */
+ObjString*
+copyHashedString(const char* chars, uint32_t length, uint32_t hash)
+{
+	// Look up a given string in 'interns table' of the VM.
+	StringSet set = { &vm.strings, &vm.objects };
+	return internHashed(&set, chars, length, hash);
+}
+
+ObjString*
+takeString(const char* chars, uint32_t length)
+{
+	StringSet set = { &vm.strings, &vm.objects };
+	return internTake(&set, chars, length);
 }
 
 void
@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "value.h"
+#include "hash_table.h"
 
 #define OBJ_TYPE(value)        (OBJ_UNPACK(value)->type)
 #define IS_STRING(value)       isObjType(value, obj_string)
@@ -25,8 +26,19 @@ struct ObjString {
 	const char* chars;
 };
 
+/* Where strings are interned: the table which finds them and the list which owns
+ * them. The VM has one, a compilation has one of its own. */
+typedef struct {
+	Table* strings;
+	Obj**  objects;
+} StringSet;
+
+ObjString* internCopy(StringSet* set, const char* chars, uint32_t length);
+ObjString* internTake(StringSet* set, const char* chars, uint32_t length);
+ObjString* internHashed(StringSet* set, const char* chars, uint32_t length, uint32_t hash);
 ObjString* takeString(const char* chars, uint32_t length);
 ObjString* copyString(const char* chars, uint32_t length);
+ObjString* copyHashedString(const char* chars, uint32_t length, uint32_t hash);
 void printObject(Value value);
 
 static inline bool
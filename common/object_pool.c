@@ -5,34 +5,154 @@
 void
 initObjPool(ObjPool* objPool)
 {
-	objPool->values = NULL;
+	objPool->count = 0;
+	objPool->capacity = 0;
+	objPool->entries = NULL;
 	objPool->size = 0;
+	objPool->values = NULL;
 }
 
 void
 freeObjPool(ObjPool* objPool)
 {
-	FREE_ARRAY(i32, objPool->values, objPool->size);
+	FREE_ARRAY(PoolString, objPool->entries, objPool->capacity);
+	FREE_ARRAY(uint8_t, objPool->values, objPool->size);
 	initObjPool(objPool);
 }
 
+static void
+growEntries(ObjPool* objPool, uint32_t count)
+{
+	if (objPool->capacity >= count)
+		return;
+
+	uint32_t oldCap = objPool->capacity;
+	objPool->capacity = GROW_CAPACITY(oldCap);
+	if (objPool->capacity < count)
+		objPool->capacity = count;
+
+	objPool->entries = GROW_ARRAY(PoolString, objPool->entries, oldCap, objPool->capacity);
+}
+
+/**
+ * Appends the packed form of the given object to the pool.
+ * @returns int32_t: the index of the new entry or -1 if the object can't be stored.
+ */
 int32_t
 writeObjPool(ObjPool* objPool, void* obj)
 {
-	uint32_t offset;
 	ObjType type = ((Obj*)obj)->type;
+	if (type != obj_string)
+		return -1;
+
+	ObjString* str = (ObjString*)obj;
+	uint8_t prefix[VARINT_MAX_LEN + sizeof(uint32_t)];
+	uint32_t prefixLen = storeVarint(prefix, str->len);
+	storeU32(prefix + prefixLen, str->hash);
+	prefixLen += sizeof(uint32_t);
+
+	uint32_t offset  = objPool->size;
+	uint32_t newSize = offset + prefixLen + str->len + 1;
+
+	growEntries(objPool, objPool->count + 1);
+	objPool->values = GROW_ARRAY(uint8_t, objPool->values, offset, newSize);
+
+	uint8_t* entry = objPool->values + offset;
+	memcpy(entry, prefix, prefixLen);
+	memcpy(entry + prefixLen, str->chars, str->len);
+	entry[prefixLen + str->len] = '\0';
+
+	PoolString* desc = &objPool->entries[objPool->count];
+	desc->len    = str->len;
+	desc->hash   = str->hash;
+	desc->offset = offset + prefixLen;
+
+	objPool->size = newSize;
+	return objPool->count++;
+}
+
+/**
+ * Decodes the descriptor of the packed entry at 'offset' within 'values'.
+ * @returns uint32_t: the size of the whole entry or 0 if it's malformed.
+ */
+uint32_t
+readPoolEntry(const uint8_t* values, uint32_t size, uint32_t offset, PoolString* desc)
+{
+	const uint8_t* end = values + size;
+	const uint8_t* pos = values + offset;
+
+	if (offset >= size)
+		return 0;
 
-	if (type == obj_string) {
-		ObjString* str = (ObjString*)obj;
-		offset = objPool->size;
+	uint32_t varLen = loadVarint(pos, end, &desc->len);
+	if (varLen == 0)
+		return 0;
 
-		objPool->size += sizeof(ObjString) + str->len;
-		objPool->values = GROW_ARRAY(uint8_t, objPool->values, offset, objPool->size);
-		memcpy(objPool->values + offset, str, sizeof(ObjString));
-		memcpy(objPool->values + sizeof(ObjString) + offset, str->chars, str->len);
+	pos += varLen;
+	if ((uint32_t)(end - pos) < sizeof(uint32_t))
+		return 0;
 
-		return offset;
+	desc->hash = loadU32(pos);
+	pos += sizeof(uint32_t);
+
+	if ((uint32_t)(end - pos) <= desc->len || pos[desc->len] != '\0')
+		return 0;
+
+	desc->offset = (uint32_t)(pos - values);
+	return (uint32_t)(pos - values) - offset + desc->len + 1;
+}
+
+/**
+ * Rebuilds 'entries' for the packed data in 'values'. The first of 'count'
+ * entries starts at 'start', the last one must end exactly at the end of 'values'.
+ * @returns bool: false if the packed data is malformed.
+ */
+bool
+indexObjPool(ObjPool* objPool, const uint8_t* start, uint32_t count)
+{
+	uint32_t offset = (uint32_t)(start - objPool->values);
+
+	// Every entry takes at least 6 bytes, don't trust 'count' beyond that.
+	if (count > (objPool->size - offset) / (1 + sizeof(uint32_t) + 1))
+		return false;
+
+	growEntries(objPool, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t entrySize = readPoolEntry(objPool->values, objPool->size, offset,
+											&objPool->entries[i]);
+		if (entrySize == 0)
+			return false;
+
+		offset += entrySize;
+		objPool->count++;
 	}
 
-	return -1;
-}
\ No newline at end of file
+	return offset == objPool->size;
+}
+
+/**
+ * Indexes 'count' entries scattered over shared packed data, e.g. the strings of
+ * an archive, whose offsets are read from the varints at 'offsets'.
+ * @returns bool: false if an offset or an entry is malformed.
+ */
+bool
+indexSharedObjPool(ObjPool* objPool, const uint8_t* offsets, const uint8_t* end, uint32_t count)
+{
+	// Every offset takes at least one byte.
+	if (count > (uint32_t)(end - offsets))
+		return false;
+
+	growEntries(objPool, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t offset;
+		uint32_t varLen = loadVarint(offsets, end, &offset);
+		if (varLen == 0 ||
+			readPoolEntry(objPool->values, objPool->size, offset, &objPool->entries[i]) == 0)
+			return false;
+
+		offsets += varLen;
+		objPool->count++;
+	}
+
+	return offsets == end;
+}
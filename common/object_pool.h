@@ -4,16 +4,34 @@
 #include "common.h"
 #include "value.h"
 #include "object.h"
+#include "byte_order.h"
 
+/* Objects are kept in the packed form they have in the .fvb file, so the pool
+ * can be written out and mapped back as is. Every string entry looks like:
+ *   varint len | u32 hash | chars[len] | '\0'
+ * Instructions address an entry by its index. Since the entries vary in size,
+ * 'entries' indexes them; it's rebuilt when a module is loaded. */
 typedef struct {
-	uint32_t size;
-	uint8_t* values;
+	uint32_t len;
+	uint32_t hash;
+	uint32_t offset;	/* <! of the characters within 'values'. */
+} PoolString;
+
+typedef struct {
+	uint32_t    count;		/* <! number of entries. */
+	uint32_t    capacity;	/* <! capacity of the 'entries' array. */
+	PoolString* entries;
+	uint32_t    size;		/* <! number of bytes used in 'values'. */
+	uint8_t*    values;
 } ObjPool;
 
-#define OBJPOOL_AS_STRING(pool)		((char*)objPool->values)
+#define OBJPOOL_STR_CHARS(pool, idx)	((const char*)(pool)->values + (pool)->entries[idx].offset)
 
 void initObjPool(ObjPool* objPool);
 void freeObjPool(ObjPool* objPool);
 int32_t writeObjPool(ObjPool* objPool, void* obj);
+uint32_t readPoolEntry(const uint8_t* values, uint32_t size, uint32_t offset, PoolString* desc);
+bool indexObjPool(ObjPool* objPool, const uint8_t* start, uint32_t count);
+bool indexSharedObjPool(ObjPool* objPool, const uint8_t* offsets, const uint8_t* end, uint32_t count);
 
-#endif /* FUNVM_OBJECT_POOL_H */
\ No newline at end of file
+#endif /* FUNVM_OBJECT_POOL_H */
@@ -0,0 +1,141 @@
+#include <stdarg.h>
+#include "verifier.h"
+#include "memory.h"
+
+static bool
+verifyError(uint32_t offset, const char* format, ...)
+{
+	va_list args;
+	fprintf(stderr, "Verification failed at offset %d: ", offset);
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputs(".\n", stderr);
+	return false;
+}
+
+/** Stack shuffles keep the types of the values they copy or move. */
+static void
+shuffleTypes(uint8_t opCode, StaticType* types, uint32_t depth)
+{
+	StaticType top = types[depth - 1];
+
+	switch (opCode) {
+		case op_dup:
+			types[depth] = top;
+		break;
+		case op_over:
+			types[depth] = types[depth - 2];
+		break;
+		case op_swap:
+			types[depth - 1] = types[depth - 2];
+			types[depth - 2] = top;
+		break;
+	}
+}
+
+static bool
+checkCode(ByteCode* bCode, StaticType* types)
+{
+	uint32_t offset = 0;
+	uint32_t depth = 0;
+	uint32_t maxDepth = 0;
+	uint8_t lastOp = op_count;
+
+	while (offset < bCode->count) {
+		uint8_t opCode = bCode->code[offset];
+		if (opCode >= op_count)
+			return verifyError(offset, "unknown opcode %d", opCode);
+
+		const OpInfo* info = &opInfo[opCode];
+		uint32_t size = instructionSize(bCode, opCode);
+		if (size > bCode->count - offset)
+			return verifyError(offset, "truncated operand of '%s'", info->name);
+
+		uint32_t operand = readOperand(bCode, offset);
+		bool indexed = (info->operand == opnd_const || info->operand == opnd_object);
+		if (bCode->encoding == enc_words && indexed && info->width > 1)
+			return verifyError(offset, "'%s' has no word encoding", info->name);
+
+		// Pool indices are bounds-checked below, any other operand has to be the one
+		// the byte encoding would have.
+		if (bCode->encoding == enc_words && !indexed && info->width < 3 && (operand >> (8 * info->width)) != 0)
+			return verifyError(offset, "operand of '%s' is too wide", info->name);
+
+		if (info->operand == opnd_const && operand >= bCode->constants.count)
+			return verifyError(offset, "constant #%d doesn't exist", operand);
+
+		if (info->operand == opnd_const && !IS_NUM(bCode->constants.values[operand]))
+			return verifyError(offset, "constant #%d isn't a number", operand);
+
+		if (info->operand == opnd_object && operand >= bCode->objects.count)
+			return verifyError(offset, "object #%d doesn't exist", operand);
+
+		if (info->operand == opnd_shift && (operand == 0 || operand > 31))
+			return verifyError(offset, "shift by %d is out of range", operand);
+
+		if (info->operand == opnd_magic && (operand >> 8) >= bCode->constants.count)
+			return verifyError(offset, "constant #%d doesn't exist", operand >> 8);
+
+		if (info->operand == opnd_magic && !IS_NUM(bCode->constants.values[operand >> 8]))
+			return verifyError(offset, "constant #%d isn't a number", operand >> 8);
+
+		if (info->operand == opnd_magic && (operand & 0xFF & ~(MAGIC_SHIFT | MAGIC_ADD)) != 0)
+			return verifyError(offset, "unknown flags of '%s'", info->name);
+
+		uint32_t pops = (info->operand == opnd_count) ? operand : info->pops;
+		if (info->operand == opnd_count && operand < 2)
+			return verifyError(offset, "'%s' needs at least two operands", info->name);
+
+		if (depth < pops)
+			return verifyError(offset, "'%s' underflows the stack", info->name);
+
+		// Specialized instructions don't check their operands, prove them here.
+		for (uint32_t i = 0; i < pops && info->takes != type_any; ++i) {
+			if (types[depth - 1 - i] != info->takes)
+				return verifyError(offset, "'%s' may get an operand of a wrong type", info->name);
+		}
+
+		if (opCode == op_dup || opCode == op_over || opCode == op_swap) {
+			shuffleTypes(opCode, types, depth);
+			depth += info->pushes - pops;
+		} else {
+			depth -= pops;
+			for (uint32_t i = 0; i < info->pushes; ++i)
+				types[depth++] = info->yields;
+		}
+
+		if (depth > maxDepth)
+			maxDepth = depth;
+
+		offset += size;
+		lastOp = opCode;
+	}
+
+	if (lastOp != op_ret)
+		return verifyError(offset, "code doesn't end with 'ret'");
+
+	bCode->maxStack = maxDepth;
+	return true;
+}
+
+/**
+ * Checks once, at load time, everything the VM takes for granted while running
+ * the code: every opcode is known, every operand fits into the code and indexes an
+ * existing pool entry, shift amounts are in range, the stack never underflows, the
+ * operands of the specialized instructions have the types they expect and the code
+ * ends with 'ret'.
+ * A linked image is several such pieces of code in a row, each ending with 'ret'.
+ * The code is straight-line, so a single pass finds the deepest stack it reaches,
+ * which is recorded in 'maxStack', and the static type of every stack slot.
+ * @returns bool: false if the code is malformed.
+ */
+bool
+verifyByteCode(ByteCode* bCode)
+{
+	// Every instruction adds one value to the stack at most.
+	StaticType* types = ALLOCATE(StaticType, bCode->count + 1);
+	bool result = checkCode(bCode, types);
+	FREE_ARRAY(StaticType, types, bCode->count + 1);
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef FUNVM_VERIFIER_H
+#define FUNVM_VERIFIER_H
+
+#include "common.h"
+#include "bytecode.h"
+
+bool verifyByteCode(ByteCode* bCode);
+
+#endif /* FUNVM_VERIFIER_H */
@@ -2,12 +2,17 @@
 #include "scanner.h"
 #include "bytecode.h"
 #include "object.h"
+#include "memory.h"
+#include "peephole.h"
+#include "cse.h"
+#include "hash_table.h"
 
 typedef struct {
 	Token current;
 	Token previous;
 	bool hadError;	/* records a errors occured during compilation. */
 	bool panicMode;	/* avoids error cascades. */
+	StaticType type;	/* static type of the expression parsed last. */
 } Parser;
 
 typedef enum {
@@ -24,7 +29,33 @@ typedef enum {
 	prec_primary,
 } Precedence;
 
-typedef void (*ParseFn)(bool canAssign);
+/* A constant operand whose load is held back, so that an operator applied to it
+ * can be evaluated at compile time. Any other instruction emits the held back
+ * loads first, in order. */
+typedef struct {
+	Value    value;
+	uint32_t line;
+} PendingConst;
+
+typedef struct {
+	PendingConst values[MAX_PENDING];
+	uint32_t count;
+	uint32_t flushes;	/* <! how many times the held back loads have been emitted. */
+} Folder;
+
+/* Everything a compilation works on, so that any number of them can run at once. */
+typedef struct {
+	Scanner    scanner;
+	Parser     parser;
+	Folder     folder;
+	ByteCode*  bCode;
+	ConstIndex constIndex;	/* <! repeated literals share one pool entry. */
+	Table      objIndex;	/* <! interned string -> its index in the object pool. */
+	Table      strings;		/* <! the strings of the literals, interned apart from the VM's ones. */
+	Obj*       objects;		/* <! owns those strings. */
+} Compiler;
+
+typedef void (*ParseFn)(Compiler* compiler, bool canAssign);
 
 typedef struct {
 	ParseFn prefix;
@@ -32,23 +63,33 @@ typedef struct {
 	Precedence prec;
 } ParseRule;
 
-static Parser parser;
-static ByteCode* currCtx;
-
-static ByteCode*
-getCurrentCtx(void)
-{
-	return currCtx;
-}
+/* An operator whose operand is being parsed, with the state it's finished with. */
+typedef struct {
+	ParseFn    rule;	/* <! grouping, unary or binary; NULL for the whole expression. */
+	TokenType  opType;
+	Precedence prec;	/* <! the lowest precedence the operand is parsed at. */
+	StaticType lhs;		/* <! static type of the left operand of a binary one. */
+	uint32_t   depth;	/* <! held back constants before the operand. */
+	uint32_t   flushes;
+} PendingOp;
+
+/* The operators parseIterative has yet to finish, innermost last. */
+typedef struct {
+	PendingOp* ops;
+	uint32_t   count;
+	uint32_t   capacity;
+} OpStack;
 
 static void
-errorAt(Token* token, const char* message)
+errorAt(Compiler* compiler, Token* token, const char* message)
 {
-	if (true == parser.panicMode)
+	if (true == compiler->parser.panicMode)
 		return;
 	
-	parser.panicMode = true;
+	compiler->parser.panicMode = true;
 
+	// Keeps the message in one piece when several compilations fail at once.
+	flockfile(stderr);
 	fprintf(stderr, "[line %d] Error", token->line);
 
 	switch (token->type) {
@@ -63,208 +104,527 @@ errorAt(Token* token, const char* message)
 	}
 
 	fprintf(stderr, ": %s\n", message);
-	parser.hadError = true;
+	funlockfile(stderr);
+	compiler->parser.hadError = true;
 }
 
 static void
-error(const char* message)
+error(Compiler* compiler, const char* message)
 {
-	errorAt(&parser.previous, message);
+	errorAt(compiler, &compiler->parser.previous, message);
 }
 
 static void
-errorAtCurrent(const char* message)
+errorAtCurrent(Compiler* compiler, const char* message)
 {
-	errorAt(&parser.current, message);
+	errorAt(compiler, &compiler->parser.current, message);
 }
 
 static void
-advance(void)
+advance(Compiler* compiler)
 {
-	parser.previous = parser.current;
+	compiler->parser.previous = compiler->parser.current;
 
 	/* Keep looping until encounter a non-error token or reach the end of file. */
 	while (true) {
-		parser.current = scanToken();
-		if (parser.current.type != tkn_err)
+		compiler->parser.current = scanToken(&compiler->scanner);
+		if (compiler->parser.current.type != tkn_err)
 			break;
 		
-		errorAtCurrent(parser.current.start);
+		errorAtCurrent(compiler, compiler->parser.current.start);
 	}
 }
 
 static void
-consume(TokenType type, const char* message)
+consume(Compiler* compiler, TokenType type, const char* message)
 {
-	if (type == parser.current.type) {
-		advance();
+	if (type == compiler->parser.current.type) {
+		advance(compiler);
 		return;
 	}
 
-	errorAtCurrent(message);
+	errorAtCurrent(compiler, message);
 }
 
 static bool
-check(const TokenType type)
+check(Compiler* compiler, const TokenType type)
 {
-	return type == parser.current.type;
+	return type == compiler->parser.current.type;
 }
 
 static bool
-match(TokenType type)
+match(Compiler* compiler, TokenType type)
 {
-	if (!check(type))
+	if (!check(compiler, type))
 		return false;
 
-	advance();
+	advance(compiler);
 	return true;
 }
 
 static void
-emitByte(uint8_t byte)
+emitByteAt(Compiler* compiler, uint8_t byte, uint32_t line)
 {
-	writeByteCode(getCurrentCtx(), byte, parser.previous.line);
+	writeByteCode(compiler->bCode, byte, line);
 }
 
-static void
-emitBytes(uint8_t byte1, uint8_t byte2)
+static uint32_t
+makeObject(Compiler* compiler, void* obj)
 {
-	emitByte(byte1);
-	emitByte(byte2);
+	Value known;
+	if (tableGet(&compiler->objIndex, (ObjString*)obj, &known))
+		return (uint32_t)NUM_UNPACK(known);
+
+	int32_t idx = addObject(compiler->bCode, obj);
+	if (idx >= 0)
+		tableSet(&compiler->objIndex, (ObjString*)obj, NUM_PACK(idx));
+
+	if (idx > MAX_POOL_INDEX) {
+		error(compiler, "Too many constants in one objects pool.");
+	} else if (idx < 0) {
+		error(compiler, "Unknown type of object.");
+		return 0;
+	}
+
+	return (uint32_t)idx;
 }
 
 static void
-emitReturn(void)
+emitObject(Compiler* compiler, void* obj, uint32_t line)
 {
-	emitByte(op_ret);
+	writeIndexed(compiler->bCode, op_obj_str, op_obj_strw, op_obj_strl, makeObject(compiler, obj), line);
 }
 
-static uint16_t
-makeObject(void* obj)
+static uint32_t
+makeConstant(Compiler* compiler, Value value)
 {
-	int32_t idx = addObject(getCurrentCtx(), obj);
-	if (idx > UINT16_MAX) {
-		error("Too many constants in one objects pool.");
-	} else if (idx < 0) {
-		error("Unknown type of object.");
+	int32_t idx = internConst(&compiler->constIndex, &compiler->bCode->constants, value);
+	if (idx > MAX_POOL_INDEX) {
+		error(compiler, "Too many constants in one chunk.");
+		return 0;
 	}
 
-	return (uint16_t)idx;
+	return (uint32_t)idx;
 }
 
 static void
-emitObject(void* obj)
+emitConstant(Compiler* compiler, Value value, uint32_t line)
 {
-	uint16_t idx = makeObject(obj);
-	if (idx <= UINT8_MAX) {
-		emitBytes(op_obj_str, idx);
+	writeIndexed(compiler->bCode, op_iconst, op_iconstw, op_iconstl, makeConstant(compiler, value), line);
+}
+
+/** Emits the cheapest instruction which pushes the given number, small ones are
+ * encoded right in the instruction stream. */
+static void
+emitNumber(Compiler* compiler, Value value, uint32_t line)
+{
+	i32 number = NUM_UNPACK(value);
+
+	if (number == 0) {
+		emitByteAt(compiler, op_zero, line);
+	} else if (number == 1) {
+		emitByteAt(compiler, op_one, line);
+	} else if (number >= INT8_MIN && number <= INT8_MAX) {
+		emitByteAt(compiler, op_push_i8, line);
+		emitByteAt(compiler, (uint8_t)number, line);
+	} else if (number >= INT16_MIN && number <= INT16_MAX) {
+		emitByteAt(compiler, op_push_i16, line);
+		emitByteAt(compiler, (uint8_t)(number >> 8), line);
+		emitByteAt(compiler, (uint8_t)number, line);
 	} else {
-		emitByte(op_obj_strw);
-		emitBytes(((idx >> 8) & 0x00FF), (idx & 0x00FF));
+		emitConstant(compiler, value, line);
 	}
 }
 
-static uint16_t
-makeConstant(Value value)
+/** Emits the instruction which loads the given constant value. */
+static void
+emitValue(Compiler* compiler, Value value, uint32_t line)
 {
-	int32_t idx = addConstant(getCurrentCtx(), value);
-	if (idx > UINT16_MAX) {
-		error("Too many constants in one chunk.");
-		exit(1);
+	switch (value.type) {
+		case val_nil:  emitByteAt(compiler, op_null, line); break;
+		case val_bool: emitByteAt(compiler, BOOL_UNPACK(value) ? op_true : op_false, line); break;
+		case val_num:  emitNumber(compiler, value, line); break;
+		case val_obj:  emitObject(compiler, OBJ_UNPACK(value), line); break;
 	}
-
-	return (uint16_t)idx;
 }
 
+/* Emits the loads of all the held back constants. */
 static void
-emitConstant(Value value)
+flushConstants(Compiler* compiler)
 {
-	uint16_t idx = makeConstant(value);
-	if (idx <= UINT8_MAX) {
-		emitBytes(op_iconst, idx);
-	} else {
-		emitByte(op_iconstw);
-		emitBytes(((idx >> 8) & 0x00FF), (idx & 0x00FF));
+	uint32_t count = compiler->folder.count;
+	if (count == 0)
+		return;
+
+	compiler->folder.count = 0;
+	compiler->folder.flushes++;
+	for (uint32_t i = 0; i < count; ++i)
+		emitValue(compiler, compiler->folder.values[i].value, compiler->folder.values[i].line);
+}
+
+static StaticType
+typeOfValue(Value value)
+{
+	switch (value.type) {
+		case val_nil:  return type_null;
+		case val_bool: return type_bool;
+		case val_num:  return type_i32;
+		case val_obj:  return type_str;	// The only objects a literal yields.
 	}
+
+	return type_any;
 }
 
 static void
-commitCompilation(void)
+pushConstant(Compiler* compiler, Value value)
 {
-	emitReturn();
+	if (compiler->folder.count == MAX_PENDING)
+		flushConstants(compiler);
+
+	compiler->folder.values[compiler->folder.count].value = value;
+	compiler->folder.values[compiler->folder.count].line  = compiler->parser.previous.line;
+	compiler->folder.count++;
+	compiler->parser.type = typeOfValue(value);
 }
 
-static void expression(void);
+static void
+emitByte(Compiler* compiler, uint8_t byte)
+{
+	flushConstants(compiler);
+	emitByteAt(compiler, byte, compiler->parser.previous.line);
+}
+
+static void
+emitReturn(Compiler* compiler)
+{
+	emitByte(compiler, op_ret);
+}
+
+static void
+commitCompilation(Compiler* compiler)
+{
+	emitReturn(compiler);
+}
+
+static void expression(Compiler* compiler);
 static ParseRule* getRule(TokenType type);
-static void parsePrecedence(Precedence precedence);
+static void parsePrecedence(Compiler* compiler, Precedence precedence);
 
+static ObjString*
+concatConstants(Compiler* compiler, ObjString* a, ObjString* b)
+{
+	uint32_t len = a->len + b->len;
+	char* chars = ALLOCATE(char, len + 1);
+	memcpy(chars, a->chars, a->len);
+	memcpy(chars + a->len, b->chars, b->len);
+	chars[len] = '\0';
+	StringSet set = { &compiler->strings, &compiler->objects };
+	return internTake(&set, chars, len);
+}
+
+/**
+ * Evaluates a binary operator over two constants the way the VM does. Operations
+ * the VM would fail at (e.g. a division by zero) are left to it, so the error is
+ * reported at run time as usual.
+ * @returns bool: false if the operation can't be evaluated at compile time.
+ */
+static bool
+foldBinary(Compiler* compiler, TokenType opType, Value a, Value b, Value* result)
+{
+	if (opType == tkn_2eq || opType == tkn_neq) {
+		*result = BOOL_PACK(valuesEqual(a, b) == (opType == tkn_2eq));
+		return true;
+	}
+
+	if (opType == tkn_plus && IS_STRING(a) && IS_STRING(b)) {
+		*result = OBJ_PACK(concatConstants(compiler, STRING_UNPACK(a), STRING_UNPACK(b)));
+		return true;
+	}
+
+	if (!IS_NUM(a) || !IS_NUM(b))
+		return false;
+
+	// The VM's arithmetic wraps around on overflow.
+	uint32_t x = (uint32_t)NUM_UNPACK(a);
+	uint32_t y = (uint32_t)NUM_UNPACK(b);
+
+	switch (opType) {
+		case tkn_plus:  *result = NUM_PACK((i32)(x + y)); break;
+		case tkn_minus: *result = NUM_PACK((i32)(x - y)); break;
+		case tkn_star:  *result = NUM_PACK((i32)(x * y)); break;
+		case tkn_slash:
+			if (y == 0)
+				return false;
+
+			*result = NUM_PACK((i32)y == -1 ? (i32)(0u - x) : (i32)x / (i32)y);
+		break;
+		case tkn_gt:   *result = BOOL_PACK((i32)x >  (i32)y); break;
+		case tkn_gteq: *result = BOOL_PACK((i32)x >= (i32)y); break;
+		case tkn_lt:   *result = BOOL_PACK((i32)x <  (i32)y); break;
+		case tkn_lteq: *result = BOOL_PACK((i32)x <= (i32)y); break;
+		default: return false;
+	}
+
+	return true;
+}
+
+/**
+ * Computes the magic number of a signed division by 'd' (d > 2, not a power of two),
+ * see Hacker's Delight, 10-1: the high half of the dividend times the magic number,
+ * plus the dividend if the magic number doesn't fit into an i32, shifted right by
+ * 'shift' is the quotient rounded toward minus infinity.
+ */
 static void
-binary(bool canAssign)
+divisionMagic(uint32_t d, i32* magic, uint8_t* shift)
+{
+	const uint32_t two31 = 0x80000000u;
+	uint32_t anc = two31 - 1 - two31 % d;	// The largest dividend with d - 1 as remainder.
+	uint32_t q1 = two31 / anc;
+	uint32_t r1 = two31 - q1 * anc;
+	uint32_t q2 = two31 / d;
+	uint32_t r2 = two31 - q2 * d;
+	uint32_t delta;
+	uint8_t p = 31;
+
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= d) {
+			q2++;
+			r2 -= d;
+		}
+
+		delta = d - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	*magic = (i32)(q2 + 1);
+	*shift = p - 32;
+}
+
+/**
+ * Replaces the multiplication or the division of a number by the held back constant
+ * on top with cheaper instructions: shifts by powers of two, a multiply by the magic
+ * number of any other divisor. A negative constant negates the result.
+ * @returns bool: false if there's nothing cheaper, the constant is left as it is.
+ */
+static bool
+reduceStrength(Compiler* compiler, TokenType opType, i32 c)
 {
-	TokenType opType = parser.previous.type;
-	ParseRule* rule = getRule(opType);
-	parsePrecedence((Precedence)(rule->prec + 1));
+	uint32_t magnitude = (c < 0) ? 0u - (uint32_t)c : (uint32_t)c;
+	uint8_t shift = 0;
+
+	while (shift < 31 && (1u << shift) < magnitude)
+		shift++;
+
+	bool power = (magnitude == (1u << shift));
+	if (magnitude == 0 || (opType != tkn_star && opType != tkn_slash) || (opType == tkn_star && !power))
+		return false;
+
+	i32 magic = 0;
+	uint32_t idx = 0;
+	if (!power) {
+		// 'mulhi' addresses its multiplier with 16 bits only, the pool doesn't get
+		// one it can't address.
+		divisionMagic(magnitude, &magic, &shift);
+		idx = findConst(&compiler->constIndex, &compiler->bCode->constants, NUM_PACK(magic));
+		if (idx > UINT16_MAX)
+			return false;
+
+		makeConstant(compiler, NUM_PACK(magic));
+	}
+
+	compiler->folder.count--;
+	if (magnitude == 1) {
+		// Nothing to do but the sign.
+	} else if (power) {
+		emitByte(compiler, (opType == tkn_star) ? op_shl : op_sar);
+		emitByte(compiler, shift);
+	} else {
+		emitByte(compiler, op_mulhi);
+		emitByte(compiler, (uint8_t)(idx >> 8));
+		emitByte(compiler, (uint8_t)idx);
+		emitByte(compiler, shift | ((magic < 0) ? MAGIC_ADD : 0));
+	}
+
+	if (c < 0)
+		emitByte(compiler, op_negate);
+
+	return true;
+}
+
+/**
+ * Picks the instruction for a binary operator. Where the static types of both
+ * operands are known to fit, it's a specialized one which skips the type checks.
+ */
+static OpCode
+binaryOpCode(TokenType opType, StaticType lhs, StaticType rhs)
+{
+	bool ints = (lhs == type_i32 && rhs == type_i32);
 
 	switch (opType) {
-		case tkn_neq:  emitBytes(op_eq, op_not); break;
-		case tkn_2eq:  emitByte(op_eq);          break;
-		case tkn_gt:   emitByte(op_gt);          break;
-		case tkn_gteq: emitBytes(op_lt, op_not); break;
-		case tkn_lt:   emitByte(op_lt);          break;
-		case tkn_lteq: emitBytes(op_gt, op_not); break;
-
-		case tkn_plus:  emitByte(op_add); break;
-		case tkn_minus: emitByte(op_sub); break;
-		case tkn_star:  emitByte(op_mul); break;
-		case tkn_slash: emitByte(op_div); break;
-		default: return; // Unreachable
+		case tkn_neq:  return op_neq;
+		case tkn_2eq:  return op_eq;
+		case tkn_gt:   return ints ? op_gt_i32 : op_gt;
+		case tkn_gteq: return ints ? op_ge_i32 : op_ge;
+		case tkn_lt:   return ints ? op_lt_i32 : op_lt;
+		case tkn_lteq: return ints ? op_le_i32 : op_le;
+
+		case tkn_plus:
+			if (lhs == type_str && rhs == type_str)
+				return op_concat_str;
+
+			return ints ? op_add_i32 : op_add;
+		case tkn_minus: return ints ? op_sub_i32 : op_sub;
+		case tkn_star:  return ints ? op_mul_i32 : op_mul;
+		case tkn_slash: return op_div;	// Still has to check for a division by zero.
+		default: return op_count; // Unreachable
 	}
 }
 
+/** Records the state an operator needs to be finished once its operand is parsed. */
+static void
+beginOperator(Compiler* compiler, PendingOp* op, ParseFn rule, TokenType opType, Precedence prec)
+{
+	op->rule    = rule;
+	op->opType  = opType;
+	op->prec    = prec;
+	op->lhs     = compiler->parser.type;
+	op->depth   = compiler->folder.count;
+	op->flushes = compiler->folder.flushes;
+}
+
+/** Emits, or folds, a binary operator whose right operand has just been parsed. */
+static void
+finishBinary(Compiler* compiler, const PendingOp* op)
+{
+	Folder* folder = &compiler->folder;
+	uint32_t depth = op->depth;
+	Value result;
+
+	// Both operands are still held back constants: replace them with the result.
+	if (depth > 0 && folder->flushes == op->flushes && folder->count == depth + 1 &&
+		foldBinary(compiler, op->opType, folder->values[depth - 1].value, folder->values[depth].value, &result)) {
+		folder->count--;
+		folder->values[depth - 1].value = result;
+		compiler->parser.type = typeOfValue(result);
+		return;
+	}
+
+	// Only the right operand is a held back number: look for a cheaper instruction.
+	if (op->lhs == type_i32 && folder->flushes == op->flushes && folder->count == depth + 1 &&
+		IS_NUM(folder->values[depth].value) && reduceStrength(compiler, op->opType, NUM_UNPACK(folder->values[depth].value))) {
+		compiler->parser.type = type_i32;
+		return;
+	}
+
+	OpCode opCode = binaryOpCode(op->opType, op->lhs, compiler->parser.type);
+	if (opCode == op_count)
+		return;
+
+	emitByte(compiler, opCode);
+	compiler->parser.type = opInfo[opCode].yields;
+}
+
+static void
+binary(Compiler* compiler, bool canAssign)
+{
+	TokenType opType = compiler->parser.previous.type;
+	PendingOp op;
+
+	beginOperator(compiler, &op, binary, opType, (Precedence)(getRule(opType)->prec + 1));
+	parsePrecedence(compiler, op.prec);
+	finishBinary(compiler, &op);
+}
+
 static void
-literal(bool canAssign)
+literal(Compiler* compiler, bool canAssign)
 {
-	switch (parser.previous.type) {
-		case tkn_null:  emitByte(op_null);  break;
-		case tkn_false: emitByte(op_false); break;
-		case tkn_true:  emitByte(op_true);  break;
+	switch (compiler->parser.previous.type) {
+		case tkn_null:  pushConstant(compiler, NULL_PACK());      break;
+		case tkn_false: pushConstant(compiler, BOOL_PACK(false)); break;
+		case tkn_true:  pushConstant(compiler, BOOL_PACK(true));  break;
 		default: return; // UNreachable.
 	}
 }
 
 static void
-grouping(bool canAssign)
+grouping(Compiler* compiler, bool canAssign)
 {
-	expression();
-	consume(tkn_rparen, "Expect ')' after expression.");
+	expression(compiler);
+	consume(compiler, tkn_rparen, "Expect ')' after expression.");
 }
 
 static void
-number(bool canAssign)
+number(Compiler* compiler, bool canAssign)
 {
-	i32 value = strtol(parser.previous.start, NULL, 10);
-	emitConstant(NUM_PACK(value));
+	// The source may end right after the literal, with no terminator to stop at.
+	Token* token = &compiler->parser.previous;
+	uint32_t value = 0;
+
+	for (uint32_t i = 0; i < token->length; ++i) {
+		uint32_t digit = (uint32_t)(token->start[i] - '0');
+		// Saturates like strtol() does with a 32-bit long.
+		value = (value > (INT32_MAX - digit) / 10) ? INT32_MAX : value * 10 + digit;
+	}
+
+	pushConstant(compiler, NUM_PACK((i32)value));
 }
 
 static void
-string(bool canAssign)
+string(Compiler* compiler, bool canAssign)
 {
+	Token* token = &compiler->parser.previous;
+	StringSet set = { &compiler->strings, &compiler->objects };
+
 	/* Trim the leading and trailing quotation marks. */
-	ObjString* objString = copyString(parser.previous.start + 1, parser.previous.length - 2);
-	emitObject((void*)objString);
+	ObjString* objString = internCopy(&set, token->start + 1, token->length - 2);
+	pushConstant(compiler, OBJ_PACK(objString));
 }
 
+/** Emits, or folds, a unary operator whose operand has just been parsed. */
 static void
-unary(bool canAssign)
+finishUnary(Compiler* compiler, const PendingOp* op)
 {
-	TokenType opType = parser.previous.type;
-	parsePrecedence(prec_unary);
+	// The operand is still a held back constant: replace it with the result.
+	if (compiler->folder.flushes == op->flushes && compiler->folder.count == op->depth + 1) {
+		Value* operand = &compiler->folder.values[op->depth].value;
+		if (op->opType == tkn_not) {
+			*operand = BOOL_PACK(IS_NULL(*operand) || (IS_BOOL(*operand) && !BOOL_UNPACK(*operand)));
+			compiler->parser.type = type_bool;
+			return;
+		}
+
+		if (op->opType == tkn_minus && IS_NUM(*operand)) {
+			*operand = NUM_PACK((i32)(0u - (uint32_t)NUM_UNPACK(*operand)));
+			return;
+		}
+	}
 
-	switch (opType) {
-		case tkn_not:   emitByte(op_not);    break;
-		case tkn_minus: emitByte(op_negate); break;
+	switch (op->opType) {
+		case tkn_not:   emitByte(compiler, op_not);    break;
+		case tkn_minus: emitByte(compiler, op_negate); break;
 		default: return; // Unreachable
 	}
+
+	compiler->parser.type = opInfo[(op->opType == tkn_not) ? op_not : op_negate].yields;
+}
+
+static void
+unary(Compiler* compiler, bool canAssign)
+{
+	PendingOp op;
+
+	beginOperator(compiler, &op, unary, compiler->parser.previous.type, prec_unary);
+	parsePrecedence(compiler, prec_unary);
+	finishUnary(compiler, &op);
 }
 
 ParseRule rules[] = {
@@ -318,27 +678,27 @@ ParseRule rules[] = {
 
 /** Parses an expression at the given precedence level or higher. */
 static void
-parsePrecedence(Precedence prec)
+parsePrecedence(Compiler* compiler, Precedence prec)
 {
-	advance();
-	ParseFn prefixRule = getRule(parser.previous.type)->prefix;
+	advance(compiler);
+	ParseFn prefixRule = getRule(compiler->parser.previous.type)->prefix;
 
 	if (prefixRule == NULL) {
-		error("expect expression.");
+		error(compiler, "expect expression.");
 		return;
 	}
 
 	bool canAssign = (prec <= prec_assignment);
-	prefixRule(canAssign);
+	prefixRule(compiler, canAssign);
 
-	while (getRule(parser.current.type)->prec >= prec) {
-		advance();
-		ParseFn infixRule = getRule(parser.previous.type)->infix;
-		infixRule(canAssign);
+	while (getRule(compiler->parser.current.type)->prec >= prec) {
+		advance(compiler);
+		ParseFn infixRule = getRule(compiler->parser.previous.type)->infix;
+		infixRule(compiler, canAssign);
 	}
 
-	if (canAssign && match(tkn_eq)) {
-		error("Invalid assignment target.");
+	if (canAssign && match(compiler, tkn_eq)) {
+		error(compiler, "Invalid assignment target.");
 	}
 }
 
@@ -349,22 +709,142 @@ getRule(TokenType type)
 }
 
 static void
-expression(void)
+expression(Compiler* compiler)
 {
-	parsePrecedence(prec_assignment);
+	parsePrecedence(compiler, prec_assignment);
 }
 
+static void
+pushOperator(Compiler* compiler, OpStack* stack, ParseFn rule, Precedence prec)
+{
+	if (stack->count == stack->capacity) {
+		uint32_t oldCapacity = stack->capacity;
+		stack->capacity = GROW_CAPACITY(oldCapacity);
+		stack->ops = GROW_ARRAY(PendingOp, stack->ops, oldCapacity, stack->capacity);
+	}
+
+	beginOperator(compiler, &stack->ops[stack->count++], rule, compiler->parser.previous.type, prec);
+}
+
+/** Finishes the innermost operator, its operand has just been parsed. */
+static void
+popOperator(Compiler* compiler, OpStack* stack)
+{
+	PendingOp* op = &stack->ops[--stack->count];
+
+	if (op->rule == grouping)
+		consume(compiler, tkn_rparen, "Expect ')' after expression.");
+	else if (op->rule == unary)
+		finishUnary(compiler, op);
+	else if (op->rule == binary)
+		finishBinary(compiler, op);
+}
+
+/**
+ * Parses an expression exactly like expression() does, with the same rules, but
+ * keeps the operators whose operands are still being parsed on a stack of its own
+ * rather than on the C one. A generated expression nested tens of thousands of
+ * levels deep takes memory in proportion to its depth and nothing else.
+ */
+static void
+parseIterative(Compiler* compiler)
+{
+	OpStack stack = { NULL, 0, 0 };
+	bool operand = true;	// An operand comes next, an infix operator otherwise.
+
+	pushOperator(compiler, &stack, NULL, prec_assignment);
+	while (stack.count > 0) {
+		PendingOp* top = &stack.ops[stack.count - 1];
+		bool canAssign = (top->prec <= prec_assignment);
+
+		// The start of parsePrecedence(): the prefix expression.
+		if (operand) {
+			advance(compiler);
+			ParseFn prefixRule = getRule(compiler->parser.previous.type)->prefix;
+
+			if (prefixRule == grouping) {
+				pushOperator(compiler, &stack, grouping, prec_assignment);
+			} else if (prefixRule == unary) {
+				pushOperator(compiler, &stack, unary, prec_unary);
+			} else if (prefixRule == NULL) {
+				error(compiler, "expect expression.");
+				popOperator(compiler, &stack);
+				operand = false;
+			} else {
+				prefixRule(compiler, canAssign);
+				operand = false;
+			}
+
+			continue;
+		}
+
+		// Its loop: the infix operators which bind at least as tight.
+		if (getRule(compiler->parser.current.type)->prec >= top->prec) {
+			advance(compiler);
+			ParseRule* rule = getRule(compiler->parser.previous.type);
+
+			if (rule->infix == binary) {
+				pushOperator(compiler, &stack, binary, (Precedence)(rule->prec + 1));
+				operand = true;
+			} else {
+				rule->infix(compiler, canAssign);
+			}
+
+			continue;
+		}
+
+		if (canAssign && match(compiler, tkn_eq))
+			error(compiler, "Invalid assignment target.");
+
+		popOperator(compiler, &stack);
+	}
+
+	FREE_ARRAY(PendingOp, stack.ops, stack.capacity);
+}
+
+/**
+ * Compiles the source of the given length, which needs no NUL terminator, into the
+ * given ByteCode. All the state of the compilation is its own, the only thing it
+ * shares is the memory allocator, so any number of sources can be compiled at once
+ * by different threads. 'iterative' parses it with parseIterative(), for sources
+ * which nest deeper than the recursive parser's C stack allows; the code is the same.
+ * @returns bool: false if the source has errors, they're reported to stderr.
+ */
 bool
-compile(const char* source, ByteCode* bCode)
-{
-	initScanner(source);
-	currCtx = bCode;
-	parser.hadError = false;
-	parser.panicMode = false;
-
-	advance();
-	expression();
-	consume(tkn_eof, "Expect end of expression.");
-	commitCompilation();
-	return !parser.hadError;
+compile(const char* source, uint32_t length, ByteCode* bCode, bool iterative)
+{
+	Compiler compiler;
+	initScanner(&compiler.scanner, source, length);
+	compiler.bCode = bCode;
+	compiler.parser.hadError = false;
+	compiler.parser.panicMode = false;
+	compiler.parser.type = type_any;
+	compiler.folder.count = 0;
+	compiler.folder.flushes = 0;
+	compiler.objects = NULL;
+	initConstIndex(&compiler.constIndex);
+	initTable(&compiler.objIndex);
+	initTable(&compiler.strings);
+
+	advance(&compiler);
+	if (iterative)
+		parseIterative(&compiler);
+	else
+		expression(&compiler);
+
+	consume(&compiler, tkn_eof, "Expect end of expression.");
+	commitCompilation(&compiler);
+	freeConstIndex(&compiler.constIndex);
+	freeTable(&compiler.objIndex);
+
+	// The object pool keeps copies of the strings.
+	freeTable(&compiler.strings);
+	freeObjectList(compiler.objects);
+
+	if (compiler.parser.hadError)
+		return false;
+
+	optimizeByteCode(bCode);
+	eliminateCommonSubexpressions(bCode);
+	return true;
 }
\ No newline at end of file
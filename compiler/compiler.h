@@ -4,6 +4,15 @@
 #include "common.h"
 #include "bytecode.h"
 
-bool compile(const char* source, ByteCode* bCode);
+/* Revision of the code the compiler generates. Bump it with every change which makes
+ * the compiler emit different code for some source, so that the modules built before
+ * are compiled again rather than reused (see BuildKey). */
+#define COMPILER_REVISION	2
+
+/* Maximum number of constants held back at once, deeper ones are emitted right away.
+ * An expression nested deeper than that is computed at run time. */
+#define MAX_PENDING 64
+
+bool compile(const char* source, uint32_t length, ByteCode* bCode, bool iterative);
 
 #endif /* FUNVM_COMPILER_H */
\ No newline at end of file
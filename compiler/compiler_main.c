@@ -1,28 +1,49 @@
 #include "common.h"
 #include "compiler.h"
 #include "memory.h"
+#include "module.h"
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define OPTION_WORDS	0x01	/* <! BuildKey option: the code is in instruction words. */
+
+/* The sources of a batch, handed out to the workers one at a time. */
+typedef struct {
+	char**          paths;
+	int             count;
+	int             next;	/* <! the first source nobody took yet. */
+	int             status;	/* <! the worst exit status of a source so far. */
+	bool            words;
+	bool            iterative;	/* <! parse with an explicit stack, see compile(). */
+	bool            force;	/* <! compile even if the module is up to date. */
+	const char*     cache;	/* <! directory of the modules built before, or NULL. */
+	pthread_mutex_t lock;
+} Batch;
+
+/* The text of a source file: mapped where mmap() exists, so that a source of any
+ * size is scanned in place, read into memory otherwise. */
+typedef struct {
+	const char* chars;
+	uint32_t    length;
+	bool        mapped;
+} Source;
 
 static void
 usage(void)
 {
-	printf("Usage:\n\tfunvmc <source.fn>\n\tfunvm source.fnb\n");
+	printf("Usage:\n\tfunvmc [--words] [--iterative] [--force] [--cache <dir>] [-j <jobs>] <source.fn>...\n");
+	printf("\tfunvm source.fnb\n");
+	printf("\t--words encodes every instruction as an aligned 32-bit word.\n");
+	printf("\t--iterative parses without recursion, for deeply nested generated sources.\n");
+	printf("\t--force compiles the sources even if their modules are up to date.\n");
+	printf("\t--cache keeps a copy of every module in the directory and reuses it.\n");
+	printf("\t-j compiles the given number of sources at once.\n");
 	exit(1);
 }
 
-static void*
-bufAlloc(uint32_t size, char* msg)
-{
-	void* buffer = fvm_alloc(size);
-	if (NULL == buffer) {
-		fprintf(stderr, "Failed to allocate memory for %s\n", msg);
-		exit(74);
-	}
-
-	return buffer;
-}
-
+/** @returns char*: the contents of the file, NULL if it can't be read. */
 static char*
-readSourceFile(const char* path)
+readSourceFile(const char* path, uint32_t* length)
 {
 	size_t fileSize;
 	FILE* file;
@@ -32,75 +53,238 @@ readSourceFile(const char* path)
 	file = fopen(path, "rb");
 	if (NULL == file) {
 		fprintf(stderr, "Couldn't open source file '%s'.\n", path);
-		exit(74);
+		return NULL;
 	}
 
 	fseek(file, 0L, SEEK_END);	/* Move file prt to EOF. */
 	fileSize = ftell(file);		/* How far we are from start of the file? */
 	rewind(file);				/* Rewind file ptr back to the beginning. */
 
-	buffer = bufAlloc(fileSize + 1, "source file");
+	buffer = fvm_alloc(fileSize + 1);
+	if (NULL == buffer) {
+		fprintf(stderr, "Failed to allocate memory for source file '%s'.\n", path);
+		fclose(file);
+		return NULL;
+	}
 
 	bytesRead = fread(buffer, sizeof(char), fileSize, file);
+	fclose(file);
 	if (bytesRead < fileSize) {
 		fprintf(stderr, "Couldn't read source file '%s'.\n", path);
-		exit(74);
+		fvm_free(buffer);
+		return NULL;
 	}
 
 	buffer[fileSize] = '\0';
-	fclose(file);
-
+	*length = (uint32_t)fileSize;
 	return buffer;
 }
 
+static bool
+openSource(const char* path, Source* source)
+{
+	uint8_t* image;
+
+	source->mapped = (mapFile(path, &image, &source->length) == NULL);
+	if (source->mapped) {
+		// An empty file has no mapping.
+		source->chars = (image != NULL) ? (const char*)image : "";
+		return true;
+	}
+
+	source->chars = readSourceFile(path, &source->length);
+	return source->chars != NULL;
+}
+
 static void
-serializeByteCode(const char* path, ByteCode* bCode)
+closeSource(Source* source)
 {
-	FILE* file;
-	ConstPool* cPool = &bCode->constants;
-	ObjPool* objPool = &bCode->objects;
+	if (!source->mapped)
+		fvm_free((char*)source->chars);
+	else if (source->length > 0)
+		unmapImage((uint8_t*)source->chars, source->length);
+}
+
+/** @returns BuildKey: the key of the module the source compiles to. */
+static BuildKey
+buildKey(Source* source, bool words)
+{
+	BuildKey key;
+	uint64_t hash = 14695981039346656037ull;
+
+	for (uint32_t i = 0; i < source->length; ++i)
+		hash = (hash ^ (uint8_t)source->chars[i]) * 1099511628211ull;
+
+	key.sourceHash = hash;
+	key.sourceSize = source->length;
+	key.compiler   = (FVB_VERSION_MAJOR << 24) | (FVB_VERSION_MINOR << 16) | COMPILER_REVISION;
+	key.options    = words ? OPTION_WORDS : 0;
+	return key;
+}
+
+/** @returns bool: true if the module at 'path' was built with the given key. */
+static bool
+isBuiltWith(const char* path, const BuildKey* key)
+{
+	BuildKey built;
+	return readBuildKey(path, &built) && built.sourceHash == key->sourceHash &&
+		built.sourceSize == key->sourceSize && built.compiler == key->compiler &&
+		built.options == key->options;
+}
+
+/** Copies the file, the copy replaces the one at 'to' at once, see createFile(). */
+static bool
+copyFile(const char* from, const char* to)
+{
+	char tempPath[FVB_MAX_PATH];
+	FILE* src = fopen(from, "rb");
+	FILE* dst = (src != NULL) ? createFile(to, tempPath, sizeof(tempPath)) : NULL;
+	char buffer[4096];
+	size_t count;
+	bool result = (dst != NULL);
+
+	while (result && (count = fread(buffer, 1, sizeof(buffer), src)) > 0)
+		result = (fwrite(buffer, 1, count, dst) == count);
+
+	result = result && !ferror(src);
+	if (dst != NULL)
+		result = commitFile(dst, tempPath, to, result);
+	if (src != NULL)
+		fclose(src);
+
+	return result;
+}
+
+/** Compiles the source into the module next to it, unless that module, or the one
+ * in the cache, was built from the same source by this very compiler already.
+ * @returns int: the exit status of the compilation, 0 on success. */
+static int
+compileFile(Batch* batch, const char* path)
+{
+	Source source;
+	if (!openSource(path, &source))
+		return 74;
+
 	char binFileName[256];
+	char cachedName[256];
+	BuildKey key = buildKey(&source, batch->words);
+	ByteCode bCode;
+	int status = 0;
 
-	sprintf(binFileName, "%sb", path);
-	file = fopen(binFileName, "wb");
-	if (NULL == file) {
-		fprintf(stderr, "Couldn't create binary file '%s'.\n", binFileName);
-		exit(74);
+	snprintf(binFileName, sizeof(binFileName), "%sb", path);
+	if (batch->cache != NULL) {
+		snprintf(cachedName, sizeof(cachedName), "%s/%016llx-%08x-%x.fvb", batch->cache,
+			(unsigned long long)key.sourceHash, key.sourceSize, key.options);
 	}
 
-	fwrite(&bCode->count,        sizeof(uint32_t), 1, file);
-	fwrite(&bCode->capacity,     sizeof(uint32_t), 1, file);
-	fwrite(&cPool->count,        sizeof(uint32_t), 1, file);
-	fwrite(&cPool->capacity,     sizeof(uint32_t), 1, file);
-	fwrite(&objPool->size,       sizeof(uint32_t), 1, file);
+	if (!batch->force && isBuiltWith(binFileName, &key)) {
+		if (batch->cache != NULL && !isBuiltWith(cachedName, &key))
+			copyFile(binFileName, cachedName);
 
-	fwrite(bCode->code,      sizeof(uint8_t),  bCode->capacity, file);
-	fwrite(cPool->values,    sizeof(uint64_t), cPool->capacity, file);
-	fwrite(objPool->values,  sizeof(uint8_t),  objPool->size,   file);
-	
-	fclose(file);
+		closeSource(&source);
+		return 0;
+	}
+
+	if (!batch->force && batch->cache != NULL && isBuiltWith(cachedName, &key) &&
+		copyFile(cachedName, binFileName)) {
+		closeSource(&source);
+		return 0;
+	}
+
+	initByteCode(&bCode);
+	if (!compile(source.chars, source.length, &bCode, batch->iterative)) {
+		printf("Failed to compile '%s'.\n", path);
+		status = 1;
+	} else {
+		if (batch->words)
+			encodeWords(&bCode);
+
+		if (!writeModule(binFileName, &bCode, &key))
+			status = 74;
+		else if (batch->cache != NULL && !copyFile(binFileName, cachedName))
+			fprintf(stderr, "Couldn't store '%s' in the cache.\n", binFileName);
+	}
+
+	freeByteCode(&bCode);
+	closeSource(&source);
+	return status;
 }
 
-int
-main(int argc, char* argv[])
+/** Takes sources off the batch and compiles them until there are none left. */
+static void*
+compileBatch(void* arg)
 {
-	if (argc != 2)
-		usage();
+	Batch* batch = (Batch*)arg;
 #if defined(FUNVM_MEM_MANAGER)
+	// Every thread allocates from a heap of its own.
 	heapInit();
 #endif
-	char* source;
-	ByteCode bCode;
-	
-	source = readSourceFile(argv[1]);
-	bool res = compile(source, &bCode);
-	if (!res) {
-		printf("Failed to compile...\n");
-		fvm_free(source);
-		exit(1);
+
+	while (true) {
+		pthread_mutex_lock(&batch->lock);
+		int i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count)
+			break;
+
+		int status = compileFile(batch, batch->paths[i]);
+
+		pthread_mutex_lock(&batch->lock);
+		if (status > batch->status)
+			batch->status = status;
+		pthread_mutex_unlock(&batch->lock);
 	}
 
-	serializeByteCode(argv[1], &bCode);
-	freeByteCode(&bCode);
-	fvm_free(source);
+	return NULL;
+}
+
+int
+main(int argc, char* argv[])
+{
+	Batch batch = { NULL, 0, 0, 0, false, false, false, NULL, PTHREAD_MUTEX_INITIALIZER };
+	long jobs = 1;
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; ++i) {
+		if (strcmp(argv[i], "--words") == 0)
+			batch.words = true;
+		else if (strcmp(argv[i], "--iterative") == 0)
+			batch.iterative = true;
+		else if (strcmp(argv[i], "--force") == 0)
+			batch.force = true;
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			batch.cache = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			jobs = strtol(argv[++i], NULL, 10);
+		else
+			usage();
+	}
+
+	if (i == argc || jobs < 1)
+		usage();
+
+	// An existing cache directory is just reused.
+	if (batch.cache != NULL)
+		mkdir(batch.cache, 0777);
+
+	batch.paths = &argv[i];
+	batch.count = argc - i;
+	if (jobs > batch.count)
+		jobs = batch.count;
+
+	// The calling thread is a worker too, -j 1 starts no threads at all.
+	pthread_t* workers = malloc(sizeof(pthread_t) * jobs);
+	long started = 1;
+	for (; started < jobs; ++started) {
+		if (pthread_create(&workers[started], NULL, compileBatch, &batch) != 0)
+			break;
+	}
+
+	compileBatch(&batch);
+	for (long w = 1; w < started; ++w)
+		pthread_join(workers[w], NULL);
+
+	free(workers);
+	pthread_mutex_destroy(&batch.lock);
+	return batch.status;
 }
\ No newline at end of file
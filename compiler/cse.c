@@ -0,0 +1,304 @@
+#include "cse.h"
+#include "memory.h"
+
+/* Deepest expression tree emitted again, emitNode() takes a C stack frame per level. */
+#define MAX_HEIGHT 4096
+
+/* A value the code computes: an instruction applied to the values of its argument
+ * nodes. Equal instructions applied to equal nodes are one node, which turns the
+ * expression trees of the code into a DAG. */
+typedef struct {
+	uint8_t  op;
+	uint32_t operand;
+	uint32_t line;
+	uint32_t args;	/* <! index of the first argument in 'Dag.args'. */
+	uint32_t arity;
+	uint32_t size;	/* <! number of instructions which compute the node. */
+	uint32_t height;	/* <! levels of the expression tree below and including it. */
+	bool     safe;	/* <! none of those instructions can fail. */
+} Node;
+
+typedef struct {
+	Node*     nodes;
+	uint32_t  count;
+	uint32_t* args;
+	uint32_t  argCount;
+	uint32_t* buckets;	/* <! node index + 1, 0 for an empty bucket. */
+	uint32_t  capacity;	/* <! number of buckets, a power of two. */
+	uint32_t* roots;	/* <! nodes which consume a value and produce none, i.e. 'ret'. */
+	uint32_t  rootCount;
+	uint32_t* stack;	/* <! nodes of the values on the stack. */
+	uint32_t  depth;
+	bool      shared;	/* <! some node is computed more than once. */
+} Dag;
+
+/** @returns bool: true if the instruction checks its operands and may fail. */
+static bool
+mayFail(uint8_t op)
+{
+	switch (op) {
+		case op_gt:
+		case op_lt:
+		case op_ge:
+		case op_le:
+		case op_add:
+		case op_sub:
+		case op_mul:
+		case op_div:
+		case op_negate:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/** @returns uint8_t: the instruction which gives the same result with the operands
+ * swapped, or op_count. */
+static uint8_t
+mirrorOf(uint8_t op)
+{
+	switch (op) {
+		case op_eq:
+		case op_neq:
+		case op_mul:
+		case op_add_i32:
+		case op_mul_i32:
+			return op;
+		case op_gt:     return op_lt;
+		case op_lt:     return op_gt;
+		case op_ge:     return op_le;
+		case op_le:     return op_ge;
+		case op_gt_i32: return op_lt_i32;
+		case op_lt_i32: return op_gt_i32;
+		case op_ge_i32: return op_le_i32;
+		case op_le_i32: return op_ge_i32;
+		default:        return op_count;
+	}
+}
+
+static uint32_t
+hashNode(Dag* dag, Node* node)
+{
+	uint32_t hash = 2166136261u;
+	hash = (hash ^ node->op) * 16777619u;
+	hash = (hash ^ node->operand) * 16777619u;
+	for (uint32_t i = 0; i < node->arity; ++i)
+		hash = (hash ^ dag->args[node->args + i]) * 16777619u;
+
+	return hash;
+}
+
+static bool
+sameNode(Dag* dag, Node* a, Node* b)
+{
+	if (a->op != b->op || a->operand != b->operand || a->arity != b->arity)
+		return false;
+
+	for (uint32_t i = 0; i < a->arity; ++i) {
+		if (dag->args[a->args + i] != dag->args[b->args + i])
+			return false;
+	}
+
+	return true;
+}
+
+/** @returns uint32_t: the index of the node equal to the given one, which is added
+ * if there's none yet. */
+static uint32_t
+internNode(Dag* dag, Node* node)
+{
+	// 'ret' consumes its value, two of them are never the same.
+	if (node->op == op_ret) {
+		dag->nodes[dag->count] = *node;
+		return dag->count++;
+	}
+
+	uint32_t mask = dag->capacity - 1;
+	for (uint32_t i = hashNode(dag, node) & mask; ; i = (i + 1) & mask) {
+		uint32_t idx = dag->buckets[i];
+		if (idx == 0) {
+			dag->nodes[dag->count] = *node;
+			dag->buckets[i] = ++dag->count;
+			return dag->count - 1;
+		}
+
+		if (sameNode(dag, &dag->nodes[idx - 1], node)) {
+			dag->argCount = node->args;
+			dag->shared = true;
+			return idx - 1;
+		}
+	}
+}
+
+/** Builds the DAG of the code.
+ * @returns bool: false if the code isn't made of expression trees, or nests them
+ * deeper than MAX_HEIGHT. */
+static bool
+buildDag(Dag* dag, ByteCode* bCode, uint32_t* lines)
+{
+	for (uint32_t offset = 0; offset < bCode->count;) {
+		uint8_t op = bCode->code[offset];
+		const OpInfo* info = &opInfo[op];
+		Node node = { op, 0, lines[offset], dag->argCount, info->pops, 1, 1, !mayFail(op) };
+
+		for (uint32_t i = 0; i < info->width; ++i)
+			node.operand = (node.operand << 8) | bCode->code[offset + 1 + i];
+
+		if (info->operand == opnd_count)
+			node.arity = node.operand;
+
+		if (info->pushes > 1 || node.arity > dag->depth)
+			return false;
+
+		dag->depth -= node.arity;
+		for (uint32_t i = 0; i < node.arity; ++i) {
+			uint32_t arg = dag->stack[dag->depth + i];
+			dag->args[dag->argCount++] = arg;
+			node.size += dag->nodes[arg].size;
+			if (dag->nodes[arg].height >= node.height)
+				node.height = dag->nodes[arg].height + 1;
+			node.safe = node.safe && dag->nodes[arg].safe;
+		}
+
+		if (node.height > MAX_HEIGHT)
+			return false;
+
+		uint32_t idx = internNode(dag, &node);
+		if (info->pushes == 1)
+			dag->stack[dag->depth++] = idx;
+		else
+			dag->roots[dag->rootCount++] = idx;
+
+		offset += 1 + info->width;
+	}
+
+	return dag->depth == 0;
+}
+
+static void
+emitInstruction(ByteCode* bCode, uint8_t op, uint32_t operand, uint32_t line)
+{
+	writeByteCode(bCode, op, line);
+	for (uint32_t i = opInfo[op].width; i > 0; --i)
+		writeByteCode(bCode, (uint8_t)(operand >> (8 * (i - 1))), line);
+}
+
+/** @returns bool: true if the node has the given argument and none of the ones
+ * before it can fail. */
+static bool
+safeArg(Dag* dag, Node* node, uint32_t arg)
+{
+	for (uint32_t i = 0; i < node->arity; ++i) {
+		uint32_t idx = dag->args[node->args + i];
+		if (idx == arg)
+			return true;
+
+		if (!dag->nodes[idx].safe)
+			return false;
+	}
+
+	return false;
+}
+
+/**
+ * Emits the code which computes the node. A node whose value is still on the
+ * stack, right on top or below it, is copied from there with 'dup' or 'over'.
+ */
+static void
+emitNode(Dag* dag, ByteCode* bCode, uint32_t idx)
+{
+	Node* node = &dag->nodes[idx];
+
+	if (node->size > 1 && dag->depth > 0 && dag->stack[dag->depth - 1] == idx) {
+		emitInstruction(bCode, op_dup, 0, node->line);
+		dag->stack[dag->depth++] = idx;
+		return;
+	}
+
+	if (node->size > 1 && dag->depth > 1 && dag->stack[dag->depth - 2] == idx) {
+		emitInstruction(bCode, op_over, 0, node->line);
+		dag->stack[dag->depth++] = idx;
+		return;
+	}
+
+	uint32_t* args = &dag->args[node->args];
+	Node* lhs = (node->arity == 2) ? &dag->nodes[args[0]] : NULL;
+	Node* rhs = (node->arity == 2) ? &dag->nodes[args[1]] : NULL;
+
+	// 'x op (x op2 y)' copies 'x' anyway, but in '(x op2 y) op x' the right operand
+	// has to be computed first to be copied into the left one, then swapped. That
+	// changes the order of evaluation, so what the left operand computes before the
+	// right one must not fail.
+	if (lhs != NULL && rhs->size > 1 && lhs->arity <= 2 && safeArg(dag, lhs, args[1])) {
+		emitNode(dag, bCode, args[1]);
+		emitNode(dag, bCode, args[0]);
+
+		uint8_t op = mirrorOf(node->op);
+		if (op == op_count) {
+			emitInstruction(bCode, op_swap, 0, node->line);
+			op = node->op;
+		}
+
+		emitInstruction(bCode, op, node->operand, node->line);
+		dag->stack[dag->depth - 2] = idx;
+		dag->depth--;
+		return;
+	}
+
+	for (uint32_t i = 0; i < node->arity; ++i)
+		emitNode(dag, bCode, dag->args[node->args + i]);
+
+	emitInstruction(bCode, node->op, node->operand, node->line);
+	dag->depth -= node->arity;
+	if (opInfo[node->op].pushes == 1)
+		dag->stack[dag->depth++] = idx;
+}
+
+/**
+ * Computes every value of a freshly compiled module once: the expression trees of
+ * the code are turned into a DAG, equal subtrees being one node, and the code is
+ * emitted again out of it. A node which is still on the stack when it's needed
+ * again is copied with 'dup' or 'over' instead, 'swap' restores the order of the
+ * operands if it had to be computed first. All the instructions but 'ret' are pure,
+ * so the code computes the same values, and fails with the same errors.
+ */
+void
+eliminateCommonSubexpressions(ByteCode* bCode)
+{
+	uint32_t count = bCode->count;
+	uint32_t capacity = 8;
+	while (capacity < count * 2)
+		capacity *= 2;
+
+	uint32_t* lines = ALLOCATE(uint32_t, count);
+	Dag dag = {
+		ALLOCATE(Node, count), 0,
+		ALLOCATE(uint32_t, count), 0,
+		ALLOCATE(uint32_t, capacity), capacity,
+		ALLOCATE(uint32_t, count), 0,
+		// Computing an operand first takes one more slot at each level.
+		ALLOCATE(uint32_t, count * 2), 0,
+		false,
+	};
+
+	memset(dag.buckets, 0, sizeof(uint32_t) * capacity);
+	expandLineTable(&bCode->lines, lines, count);
+
+	if (buildDag(&dag, bCode, lines) && dag.shared) {
+		FREE_ARRAY(uint8_t, bCode->code, bCode->capacity);
+		freeLineTable(&bCode->lines);
+		bCode->code = NULL;
+		bCode->count = 0;
+		bCode->capacity = 0;
+
+		for (uint32_t i = 0; i < dag.rootCount; ++i)
+			emitNode(&dag, bCode, dag.roots[i]);
+	}
+
+	FREE_ARRAY(Node, dag.nodes, count);
+	FREE_ARRAY(uint32_t, dag.args, count);
+	FREE_ARRAY(uint32_t, dag.buckets, capacity);
+	FREE_ARRAY(uint32_t, dag.roots, count);
+	FREE_ARRAY(uint32_t, dag.stack, count * 2);
+	FREE_ARRAY(uint32_t, lines, count);
+}
\ No newline at end of file
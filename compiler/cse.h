@@ -0,0 +1,9 @@
+#ifndef FUNVM_CSE_H
+#define FUNVM_CSE_H
+
+#include "common.h"
+#include "bytecode.h"
+
+void eliminateCommonSubexpressions(ByteCode* bCode);
+
+#endif /* FUNVM_CSE_H */
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include "peephole.h"
+#include "memory.h"
+
+typedef struct {
+	uint8_t  op;
+	uint32_t operand;
+	uint32_t line;
+} Instruction;
+
+/* The optimized instructions, patterns are matched against its tail. */
+typedef struct {
+	uint32_t     count;
+	Instruction* ins;
+} Window;
+
+/** @returns uint8_t: the comparison which yields the opposite result, or op_count. */
+static uint8_t
+inverseOf(uint8_t op)
+{
+	switch (op) {
+		case op_eq:     return op_neq;
+		case op_neq:    return op_eq;
+		case op_lt:     return op_ge;
+		case op_ge:     return op_lt;
+		case op_gt:     return op_le;
+		case op_le:     return op_gt;
+		case op_lt_i32: return op_ge_i32;
+		case op_ge_i32: return op_lt_i32;
+		case op_gt_i32: return op_le_i32;
+		case op_le_i32: return op_gt_i32;
+		default:        return op_count;
+	}
+}
+
+/** @returns uint32_t: the number of strings the instruction concatenates, or 0. */
+static uint32_t
+concatCount(Instruction* ins)
+{
+	if (ins->op == op_concat_str)
+		return 2;
+
+	return (ins->op == op_concat) ? ins->operand : 0;
+}
+
+/**
+ * Merges a concatenation of two strings with the one which produced either of its
+ * operands, concatenation being associative: 'a b concat_str c concat_str' and
+ * 'a b c concat_str concat_str' both become 'a b c concat 3'.
+ * @returns bool: true if the instruction has been merged into the window.
+ */
+static bool
+mergeConcat(Window* out, Instruction* in)
+{
+	if (out->count == 0)
+		return false;
+
+	// The right operand is produced by the last instruction.
+	Instruction* last = &out->ins[out->count - 1];
+	uint32_t count = concatCount(last);
+	if (count > 0 && count < UINT8_MAX) {
+		last->op = op_concat;
+		last->operand = count + 1;
+		return true;
+	}
+
+	// The left operand is produced right before the code of the right one.
+	uint32_t start = out->count;
+	uint32_t need = 1;
+	while (need > 0 && start > 0) {
+		Instruction* ins = &out->ins[--start];
+		uint32_t pops = (opInfo[ins->op].operand == opnd_count) ? ins->operand : opInfo[ins->op].pops;
+		need = need - opInfo[ins->op].pushes + pops;
+	}
+
+	if (need > 0 || start == 0)
+		return false;
+
+	count = concatCount(&out->ins[start - 1]);
+	if (count == 0 || count >= UINT8_MAX)
+		return false;
+
+	// Its operands stay on the stack below the right operand until the merged one runs.
+	memmove(&out->ins[start - 1], &out->ins[start], sizeof(Instruction) * (out->count - start));
+	last = &out->ins[out->count - 1];
+	last->op = op_concat;
+	last->operand = count + 1;
+	last->line = in->line;
+	return true;
+}
+
+/** Appends the instruction, merging it with the tail of the window where possible. */
+static void
+append(Window* out, Instruction* in)
+{
+	Instruction* last = (out->count > 0) ? &out->ins[out->count - 1] : NULL;
+	StaticType before = (out->count > 1) ? opInfo[out->ins[out->count - 2].op].yields : type_any;
+
+	if (last != NULL && in->op == op_not) {
+		// 'lt not' -> 'ge', etc.
+		if (inverseOf(last->op) != op_count) {
+			last->op = inverseOf(last->op);
+			return;
+		}
+
+		if (last->op == op_true || last->op == op_false) {
+			last->op = (last->op == op_true) ? op_false : op_true;
+			return;
+		}
+
+		// 'not not' is a no-op on a value which is already a boolean.
+		if (last->op == op_not && before == type_bool) {
+			out->count--;
+			return;
+		}
+	}
+
+	if (in->op == op_concat_str && mergeConcat(out, in))
+		return;
+
+	// 'negate negate' is a no-op on a value which is known to be a number.
+	if (last != NULL && in->op == op_negate && last->op == op_negate && before == type_i32) {
+		out->count--;
+		return;
+	}
+
+	out->ins[out->count++] = *in;
+}
+
+/**
+ * Rewrites the code of a freshly compiled module, replacing short instruction
+ * sequences with cheaper equivalents. The code is straight-line, so instructions
+ * can be merged or dropped without fixing up any jumps.
+ */
+void
+optimizeByteCode(ByteCode* bCode)
+{
+	uint32_t count = bCode->count;
+	uint32_t* lines = ALLOCATE(uint32_t, count);
+	Window out = { 0, ALLOCATE(Instruction, count) };
+
+	expandLineTable(&bCode->lines, lines, count);
+
+	for (uint32_t offset = 0; offset < count;) {
+		Instruction in = { bCode->code[offset], 0, lines[offset] };
+		uint8_t width = opInfo[in.op].width;
+
+		for (uint32_t i = 0; i < width; ++i)
+			in.operand = (in.operand << 8) | bCode->code[offset + 1 + i];
+
+		append(&out, &in);
+		offset += 1 + width;
+	}
+
+	FREE_ARRAY(uint8_t, bCode->code, bCode->capacity);
+	freeLineTable(&bCode->lines);
+	bCode->code = NULL;
+	bCode->count = 0;
+	bCode->capacity = 0;
+
+	for (uint32_t i = 0; i < out.count; ++i) {
+		Instruction* in = &out.ins[i];
+		uint8_t width = opInfo[in->op].width;
+
+		writeByteCode(bCode, in->op, in->line);
+		for (uint32_t j = width; j > 0; --j)
+			writeByteCode(bCode, (uint8_t)(in->operand >> (8 * (j - 1))), in->line);
+	}
+
+	FREE_ARRAY(Instruction, out.ins, count);
+	FREE_ARRAY(uint32_t, lines, count);
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef FUNVM_PEEPHOLE_H
+#define FUNVM_PEEPHOLE_H
+
+#include "common.h"
+#include "bytecode.h"
+
+void optimizeByteCode(ByteCode* bCode);
+
+#endif /* FUNVM_PEEPHOLE_H */
\ No newline at end of file
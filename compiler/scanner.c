@@ -1,281 +1,282 @@
 #include "scanner.h"
 
-typedef struct {
-	const char* start;		/* <! beginning of the current lexeme. */
-	const char* current;	/* <! current character being looked at. */
-	uint32_t line;			/* <! for error reporting purposes. */
-} Scanner;
+/* Character classes, see charClass. */
+#define CHAR_ALPHA		0x01	/* <! starts an identifier. */
+#define CHAR_DIGIT		0x02
+#define CHAR_BLANK		0x04	/* <! skipped between tokens, '\n' included. */
+#define CHAR_EQ_FORM	0x08	/* <! followed by '=' makes the token right after its own one. */
 
-Scanner scanner;
+static const uint8_t charClass[256] = {
+	['a' ... 'z'] = CHAR_ALPHA,
+	['A' ... 'Z'] = CHAR_ALPHA,
+	['_']         = CHAR_ALPHA,
+	['0' ... '9'] = CHAR_DIGIT,
+	[' ']  = CHAR_BLANK,
+	['\t'] = CHAR_BLANK,
+	['\r'] = CHAR_BLANK,
+	['\n'] = CHAR_BLANK,
+	['!']  = CHAR_EQ_FORM,
+	['=']  = CHAR_EQ_FORM,
+	['<']  = CHAR_EQ_FORM,
+	['>']  = CHAR_EQ_FORM,
+};
 
-void
-initScanner(const char* source)
-{
-	scanner.start = source;
-	scanner.current = source;
-	scanner.line = 1;
-}
+/* The token of every character which is a token by itself, tkn_err for the rest. */
+static const uint8_t singleTokens[256] = {
+	[0 ... 255] = tkn_err,
+	['('] = tkn_lparen,
+	[')'] = tkn_rparen,
+	['{'] = tkn_lbrace,
+	['}'] = tkn_rbrace,
+	[';'] = tkn_semicolon,
+	[','] = tkn_comma,
+	['.'] = tkn_dot,
+	['-'] = tkn_minus,
+	['+'] = tkn_plus,
+	['/'] = tkn_slash,
+	['*'] = tkn_star,
+	['!'] = tkn_not,
+	['='] = tkn_eq,
+	['<'] = tkn_lt,
+	['>'] = tkn_gt,
+};
 
-static bool
-isAlpha(char c)
-{
-	return  (c >= 'a' && c <= 'z') ||
-			(c >= 'A' && c <= 'Z') ||
-			c == '_';
-}
+typedef struct {
+	const char* name;
+	uint8_t     length;
+	uint8_t     type;
+} Keyword;
 
-static bool
-isDigit(char c)
+/* Perfect hash of the keywords: none of them share a slot. */
+#define KEYWORD_SLOT(first, last, length)	((((uint8_t)(first)) * 8 + ((uint8_t)(last)) * 13 + (length)) & 31)
+#define KEYWORD(name, first, last, type)	[KEYWORD_SLOT(first, last, sizeof(name) - 1)] = \
+	{ name, sizeof(name) - 1, type }
+
+static const Keyword keywords[32] = {
+	KEYWORD("break",    'b', 'k', tkn_break),
+	KEYWORD("class",    'c', 's', tkn_class),
+	KEYWORD("continue", 'c', 'e', tkn_continue),
+	KEYWORD("else",     'e', 'e', tkn_else),
+	KEYWORD("false",    'f', 'e', tkn_false),
+	KEYWORD("for",      'f', 'r', tkn_for),
+	KEYWORD("fun",      'f', 'n', tkn_fun),
+	KEYWORD("i32",      'i', '2', tkn_i32),
+	KEYWORD("if",       'i', 'f', tkn_if),
+	KEYWORD("null",     'n', 'l', tkn_null),
+	KEYWORD("return",   'r', 'n', tkn_ret),
+	KEYWORD("super",    's', 'r', tkn_super),
+	KEYWORD("switch",   's', 'h', tkn_switch),
+	KEYWORD("this",     't', 's', tkn_this),
+	KEYWORD("true",     't', 'e', tkn_true),
+	KEYWORD("while",    'w', 'e', tkn_while),
+};
+
+void
+initScanner(Scanner* scanner, const char* source, uint32_t length)
 {
-	return c >= '0' && c <= '9';
+	scanner->start = source;
+	scanner->current = source;
+	scanner->end = source + length;
+	scanner->line = 1;
 }
 
 static bool
-isAtEnd(void)
+isAtEnd(Scanner* scanner)
 {
-	return *scanner.current == '\0';
+	return scanner->current >= scanner->end;
 }
 
 /** Consumes the current character and returns it. */
 static char
-advance(void)
+advance(Scanner* scanner)
 {
-	scanner.current++;
-	return scanner.current[-1];
+	scanner->current++;
+	return scanner->current[-1];
 }
 
 /** Returns the current character without consuming it. */
 static char
-peek(void)
+peek(Scanner* scanner)
 {
-	return *scanner.current;
+	if (isAtEnd(scanner))
+		return '\0';
+
+	return *scanner->current;
 }
 
 static char
-peekNext(void)
+peekNext(Scanner* scanner)
 {
-	if (isAtEnd())
+	if (scanner->current + 1 >= scanner->end)
 		return '\0';
 
-	return scanner.current[1];
+	return scanner->current[1];
 }
 
 /** Conditionally consumes the next character if and only if its value
  * matches the expected one.
  */
 static bool
-isNext(char expected)
+isNext(Scanner* scanner, char expected)
 {
-	if (isAtEnd())
+	if (isAtEnd(scanner))
 		return false;
 	
-	if (*scanner.current != expected)
+	if (*scanner->current != expected)
 		return false;
 	
-	scanner.current++;
+	scanner->current++;
 	return true;
 }
 
 static Token
-makeToken(TokenType type)
+makeToken(Scanner* scanner, TokenType type)
 {
 	Token token;
 	token.type = type;
-	token.start = scanner.start;
-	token.length = (uint32_t)(scanner.current - scanner.start);
-	token.line = scanner.line;
+	token.start = scanner->start;
+	token.length = (uint32_t)(scanner->current - scanner->start);
+	token.line = scanner->line;
 	return token;
 }
 
 static Token
-errorToken(const char* msg)
+errorToken(Scanner* scanner, const char* msg)
 {
 	Token token;
 	token.type = tkn_err;
 	token.start = msg;
 	token.length = (uint32_t)strlen(msg);
-	token.line = scanner.line;
+	token.line = scanner->line;
 	return token;
 }
 
+/** Moves to the first character which isn't blank, counting the lines on the way. */
 static void
-skipWhiteSpace(void)
+skipBlanks(Scanner* scanner)
 {
-	while (true) {
-		char c = peek();
-		switch (c) {
-			case ' ':
-			case '\r':
-			case '\t':
-				advance();
-			break;
-			case '\n':
-				scanner.line++;
-				advance();
-			break;
-			case '/':
-				if (peekNext() == '/') {
-					while (peek() != '\n' && !isAtEnd()) {
-						advance();
-					}
-				} else if(peekNext() == '*') {
-					advance(); // consume '/'
-					advance(); // consume '*'
-
-					while (true) {
-						if (isAtEnd())
-							return;
-
-						if (peek() == '\n')
-							scanner.line++;
-
-						if (peek() == '*' && peekNext() == '/') {
-							advance();	// consume '*'
-							advance(); // consume '/'
-							break;
-						}
-						advance();
-					}
-				} else {
-					return;
-				}
-			break;
-			default: return;
-		}
+	const char* p = scanner->current;
+	for (; p < scanner->end && (charClass[(uint8_t)*p] & CHAR_BLANK); ++p) {
+		if (*p == '\n')
+			scanner->line++;
 	}
+
+	scanner->current = p;
 }
 
-static TokenType
-checkKeyword(int32_t start, uint32_t length, const char* rest, TokenType type)
+/** Moves to the next 'stop' character, or to the end, counting the lines on the way. */
+static void
+skipTo(Scanner* scanner, char stop)
 {
-	if ((scanner.current - scanner.start) == (start + length) &&
-		(memcmp(scanner.start + start, rest, length) == 0)) {
-			return type;
+	const char* p = scanner->current;
+	for (; p < scanner->end && *p != stop; ++p) {
+		if (*p == '\n')
+			scanner->line++;
 	}
 
-	return tkn_id;
+	scanner->current = p;
 }
 
-static TokenType
-identifierType(void)
+static void
+skipWhiteSpace(Scanner* scanner)
 {
-	switch (scanner.start[0]) {
-		
-		case 'b': return checkKeyword(1, 4, "reak", tkn_break);
-		case 'e': return checkKeyword(1, 3, "lse", tkn_else);
-		case 'n': return checkKeyword(1, 3, "ull", tkn_null);
-		case 'r': return checkKeyword(1, 5, "eturn", tkn_ret);
-		case 'w': return checkKeyword(1, 4, "hile", tkn_while);
-		case 'c':
-			if ((scanner.current - scanner.start) > 1) {
-				switch (scanner.start[1]) {
-					case 'l': return checkKeyword(2, 3, "ass", tkn_class);
-					case 'o': return checkKeyword(2, 6, "ntinue", tkn_continue);
-				}
-			}
-		case 's':
-			if ((scanner.current - scanner.start) > 1) {
-				switch (scanner.start[1]) {
-					case 'w': return checkKeyword(2, 4, "itch", tkn_switch);
-					case 'u': return checkKeyword(2, 3, "per", tkn_super);
-				}
-			}
-		case 'f':
-			if ((scanner.current - scanner.start) > 1) {
-				switch (scanner.start[1]) {
-					case 'a': return checkKeyword(2, 3, "lse", tkn_false);
-					case 'o': return checkKeyword(2, 1, "r", tkn_for);
-					case 'u': return checkKeyword(2, 1, "n", tkn_fun);
-				}
-			}
-		case 't':
-			if ((scanner.current - scanner.start) > 1) {
-				switch (scanner.start[1]) {
-					case 'h': return checkKeyword(2, 2, "is", tkn_this);
-					case 'r': return checkKeyword(2, 2, "ue", tkn_true);
-				}
-			}
-		case 'i':
-			if ((scanner.current - scanner.start) > 1) {
-				switch (scanner.start[1]) {
-					case 'f': return checkKeyword(0, 2, "if", tkn_if);
-					case '3': return checkKeyword(0, 3, "i32", tkn_i32);
-				}
+	while (true) {
+		skipBlanks(scanner);
+		if (peek(scanner) != '/')
+			return;
+
+		if (peekNext(scanner) == '/') {
+			skipTo(scanner, '\n');	// The newline is skipped as a blank.
+		} else if (peekNext(scanner) == '*') {
+			scanner->current += 2;	// consume '/*'
+
+			while (true) {
+				skipTo(scanner, '*');
+				if (isAtEnd(scanner))
+					return;
+
+				advance(scanner);	// consume '*'
+				if (isNext(scanner, '/'))
+					break;
 			}
+		} else {
+			return;
+		}
 	}
+}
+
+static TokenType
+identifierType(Scanner* scanner)
+{
+	uint32_t length = (uint32_t)(scanner->current - scanner->start);
+	const Keyword* keyword = &keywords[KEYWORD_SLOT(scanner->start[0], scanner->start[length - 1], length)];
+
+	if (keyword->length == length && memcmp(scanner->start, keyword->name, length) == 0)
+		return (TokenType)keyword->type;
+
 	return tkn_id;
 }
 
 static Token
-identifier(void)
+identifier(Scanner* scanner)
 {
-	while (isAlpha(peek()) || isDigit(peek()))
-		advance();
-	
-	return makeToken(identifierType());
+	const char* p = scanner->current;
+	while (p < scanner->end && (charClass[(uint8_t)*p] & (CHAR_ALPHA | CHAR_DIGIT)))
+		p++;
+
+	scanner->current = p;
+	return makeToken(scanner, identifierType(scanner));
 }
 
 static Token
-number(void)
+number(Scanner* scanner)
 {
-	while (isDigit(peek()))
-		advance();
-	
-	return makeToken(tkn_i32);
+	const char* p = scanner->current;
+	while (p < scanner->end && (charClass[(uint8_t)*p] & CHAR_DIGIT))
+		p++;
+
+	scanner->current = p;
+	return makeToken(scanner, tkn_i32);
 }
 
 static Token
-string(void)
+string(Scanner* scanner)
 {
-	while (peek() != '"' && !isAtEnd()) {
-		if (peek() == '\n')
-			scanner.line++;
-		advance();
-	}
-
-	if (isAtEnd())
-		return errorToken("Unterminated string.");
+	skipTo(scanner, '"');
+	if (isAtEnd(scanner))
+		return errorToken(scanner, "Unterminated string.");
 	
 	// Consume the closing quote.
-	advance();
-	return makeToken(tkn_str);
+	advance(scanner);
+	return makeToken(scanner, tkn_str);
 }
 
 Token
-scanToken(void)
+scanToken(Scanner* scanner)
 {
-	skipWhiteSpace();
-	scanner.start = scanner.current;
-	if (isAtEnd())
-		return makeToken(tkn_eof);
+	skipWhiteSpace(scanner);
+	scanner->start = scanner->current;
+	if (isAtEnd(scanner))
+		return makeToken(scanner, tkn_eof);
 	
-	char c = advance();
-	if (isAlpha(c))
-		return identifier();
-
-	if (isDigit(c))
-		return number();
-
-	switch (c) {
-		case '(': return makeToken(tkn_lparen);
-		case ')': return makeToken(tkn_rparen);
-		case '{': return makeToken(tkn_lbrace);
-		case '}': return makeToken(tkn_rbrace);
-		case ';': return makeToken(tkn_semicolon);
-		case ',': return makeToken(tkn_comma);
-		case '.': return makeToken(tkn_dot);
-		case '-': return makeToken(tkn_minus);
-		case '+': return makeToken(tkn_plus);
-		case '/': return makeToken(tkn_slash);
-		case '*': return makeToken(tkn_star);
-		case '!': return makeToken(isNext('=') ? tkn_neq  : tkn_not);
-		case '=': return makeToken(isNext('=') ? tkn_2eq  : tkn_eq);
-		case '<': return makeToken(isNext('=') ? tkn_lteq : tkn_lt);
-		case '>': return makeToken(isNext('=') ? tkn_gteq : tkn_gt);
-		case '"': return string();
-		// case '': return makeToken(tkn_);
-		// case '': return makeToken(tkn_);
-	}
+	char c = advance(scanner);
+	uint8_t charType = charClass[(uint8_t)c];
+	if (charType & CHAR_ALPHA)
+		return identifier(scanner);
+
+	if (charType & CHAR_DIGIT)
+		return number(scanner);
+
+	if (c == '"')
+		return string(scanner);
+
+	TokenType type = (TokenType)singleTokens[(uint8_t)c];
+	if (type == tkn_err)
+		return errorToken(scanner, "Unexpected character.");
+
+	// '!=', '==', '<=' and '>=' follow their one character tokens in TokenType.
+	if ((charType & CHAR_EQ_FORM) && isNext(scanner, '='))
+		type++;
 
-	return errorToken("Unexpected character.");
+	return makeToken(scanner, type);
 }
\ No newline at end of file
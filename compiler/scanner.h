@@ -60,7 +60,14 @@ typedef struct {
 	uint32_t line;
 } Token;
 
-void initScanner(const char* source);
-Token scanToken(void);
+typedef struct {
+	const char* start;		/* <! beginning of the current lexeme. */
+	const char* current;	/* <! current character being looked at. */
+	const char* end;		/* <! the source isn't NUL-terminated, e.g. a mapped file. */
+	uint32_t line;			/* <! for error reporting purposes. */
+} Scanner;
+
+void initScanner(Scanner* scanner, const char* source, uint32_t length);
+Token scanToken(Scanner* scanner);
 
 #endif /* FUNVM_SCANNER_H */
\ No newline at end of file
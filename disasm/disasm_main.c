@@ -0,0 +1,48 @@
+#include "common.h"
+#include "memory.h"
+#include "module.h"
+#include "verifier.h"
+#include "disassembler.h"
+
+static void
+usage(void)
+{
+	printf("Usage:\n\tFVMdis [--stats] <module.fvb>...\n");
+	printf("\t--stats  print only the opcode statistics of all the given modules.\n");
+	exit(1);
+}
+
+int
+main(int argc, char* argv[])
+{
+	bool statsOnly = false;
+	int first = 1;
+	OpStats stats;
+
+	if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+		statsOnly = true;
+		first = 2;
+	}
+
+	if (first >= argc)
+		usage();
+#if defined(FUNVM_MEM_MANAGER)
+	heapInit();
+#endif
+	initOpStats(&stats);
+
+	for (int i = first; i < argc; ++i) {
+		ByteCode bCode;
+		initByteCode(&bCode);
+		if (!readModule(argv[i], &bCode))
+			exit(74);
+
+		// Only fills in 'maxStack', malformed code is still shown.
+		verifyByteCode(&bCode);
+		disassembleByteCode(&bCode, argv[i], !statsOnly, &stats);
+		freeByteCode(&bCode);
+	}
+
+	printOpStats(&stats);
+	return (0);
+}
\ No newline at end of file
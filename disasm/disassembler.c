@@ -0,0 +1,158 @@
+#include "disassembler.h"
+#include "memory.h"
+
+void
+initOpStats(OpStats* stats)
+{
+	memset(stats, 0, sizeof(OpStats));
+}
+
+static void
+printOperand(ByteCode* bCode, const OpInfo* info, uint32_t operand)
+{
+	switch (info->operand) {
+		case opnd_none:
+		break;
+		case opnd_const:
+			printf("%-6d ", operand);
+			if (operand < bCode->constants.count)
+				printValue(bCode->constants.values[operand]);
+			else
+				printf("<out of range>");
+		break;
+		case opnd_count:
+		case opnd_shift:
+			printf("%d", operand);
+		break;
+		case opnd_magic:
+			printf("%-6d ", operand >> 8);
+			if ((operand >> 8) < bCode->constants.count)
+				printValue(bCode->constants.values[operand >> 8]);
+			else
+				printf("<out of range>");
+			printf(" >> %d%s", operand & MAGIC_SHIFT, (operand & MAGIC_ADD) ? " add" : "");
+		break;
+		case opnd_imm:
+			// Sign-extend the operand from its width.
+			printf("%d", (i32)(operand << (32 - 8 * info->width)) >> (32 - 8 * info->width));
+		break;
+		case opnd_object:
+			printf("%-6d ", operand);
+			if (operand < bCode->objects.count)
+				printf("\"%s\"", OBJPOOL_STR_CHARS(&bCode->objects, operand));
+			else
+				printf("<out of range>");
+		break;
+	}
+}
+
+/**
+ * Decodes the instruction at 'offset', optionally prints it and accounts it in 'stats'.
+ * 'lines' holds the line of every code byte.
+ * @returns uint32_t: the offset of the next instruction.
+ */
+static uint32_t
+disassembleInstruction(ByteCode* bCode, const uint32_t* lines, uint32_t offset, bool print, OpStats* stats)
+{
+	uint8_t opCode = bCode->code[offset];
+	uint32_t line = lines[offset];
+
+	if (print) {
+		printf("%04d ", offset);
+		if (offset > 0 && line == lines[offset - 1])
+			printf("   | ");
+		else
+			printf("%4d ", line);
+	}
+
+	if (opCode >= op_count) {
+		uint32_t size = (bCode->encoding == enc_words) ? INSTRUCTION_WORD : 1;
+		if (size > bCode->count - offset)
+			size = bCode->count - offset;
+
+		if (print)
+			printf("<unknown 0x%02X>\n", opCode);
+		stats->unknown += size;
+		return offset + size;
+	}
+
+	const OpInfo* info = &opInfo[opCode];
+	uint32_t size = instructionSize(bCode, opCode);
+	if (size > bCode->count - offset) {
+		if (print)
+			printf("%-10s <truncated>\n", info->name);
+		stats->unknown += bCode->count - offset;
+		return bCode->count;
+	}
+
+	uint32_t operand = readOperand(bCode, offset);
+
+	if (print) {
+		printf("%-10s ", info->name);
+		printOperand(bCode, info, operand);
+		printf("\n");
+	}
+
+	stats->count[opCode]++;
+	stats->bytes[opCode] += size;
+	return offset + size;
+}
+
+/** Prints the code of the given module and adds its instructions to 'stats'. */
+void
+disassembleByteCode(ByteCode* bCode, const char* name, bool print, OpStats* stats)
+{
+	if (print) {
+		printf("== %s ==\n", name);
+		printf("code %d bytes, %d constants, %d objects",
+			bCode->count, bCode->constants.count, bCode->objects.count);
+		if (bCode->maxStack > 0)
+			printf(", max stack %d", bCode->maxStack);
+		if (bCode->encoding == enc_words)
+			printf(", instruction words");
+		printf("\n");
+	}
+
+	// Decoding the line table once keeps the lookups linear in the size of the code.
+	uint32_t* lines = ALLOCATE(uint32_t, bCode->count);
+	expandLineTable(&bCode->lines, lines, bCode->count);
+
+	for (uint32_t offset = 0; offset < bCode->count;)
+		offset = disassembleInstruction(bCode, lines, offset, print, stats);
+
+	FREE_ARRAY(uint32_t, lines, bCode->count);
+
+	stats->modules++;
+	stats->codeBytes += bCode->count;
+	stats->constants += bCode->constants.count;
+	stats->objects   += bCode->objects.count;
+}
+
+void
+printOpStats(OpStats* stats)
+{
+	uint32_t instructions = 0;
+	for (uint32_t i = 0; i < op_count; ++i)
+		instructions += stats->count[i];
+
+	printf("== statistics ==\n");
+	printf("%d modules, %d instructions in %d code bytes, %d constants, %d objects\n",
+		stats->modules, instructions, stats->codeBytes, stats->constants, stats->objects);
+
+	if (instructions == 0)
+		return;
+
+	printf("%-10s %8s %7s %8s %7s\n", "opcode", "count", "count%", "bytes", "bytes%");
+	for (uint32_t i = 0; i < op_count; ++i) {
+		if (stats->count[i] == 0)
+			continue;
+
+		printf("%-10s %8d %6.1f%% %8d %6.1f%%\n", opInfo[i].name,
+			stats->count[i], 100.0 * stats->count[i] / instructions,
+			stats->bytes[i], 100.0 * stats->bytes[i] / stats->codeBytes);
+	}
+
+	if (stats->unknown > 0)
+		printf("%-10s %8s %7s %8d %6.1f%%\n", "<unknown>", "", "",
+			stats->unknown, 100.0 * stats->unknown / stats->codeBytes);
+}
\ No newline at end of file
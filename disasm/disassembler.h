@@ -0,0 +1,22 @@
+#ifndef FUNVM_DISASSEMBLER_H
+#define FUNVM_DISASSEMBLER_H
+
+#include "common.h"
+#include "bytecode.h"
+
+/* Static per-opcode statistics, accumulated over any number of modules. */
+typedef struct {
+	uint32_t modules;
+	uint32_t codeBytes;
+	uint32_t constants;
+	uint32_t objects;
+	uint32_t count[op_count];	/* <! how many times each opcode occurs. */
+	uint32_t bytes[op_count];	/* <! code bytes taken by each opcode, operands included. */
+	uint32_t unknown;			/* <! bytes which don't decode into an instruction. */
+} OpStats;
+
+void initOpStats(OpStats* stats);
+void disassembleByteCode(ByteCode* bCode, const char* name, bool print, OpStats* stats);
+void printOpStats(OpStats* stats);
+
+#endif /* FUNVM_DISASSEMBLER_H */
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "linker.h"
+#include "memory.h"
+#include "hash_table.h"
+
+#define MAX_POOL_ENTRIES	(MAX_POOL_INDEX + 1)
+
+/** @returns uint32_t: the index of the string in the image, which gets it if it's new. */
+static uint32_t
+linkString(StringSet* set, Table* strings, ByteCode* image, ObjPool* objPool, uint32_t i)
+{
+	PoolString* desc = &objPool->entries[i];
+	ObjString* str = internHashed(set, OBJPOOL_STR_CHARS(objPool, i), desc->len, desc->hash);
+	Value idx;
+
+	if (!tableGet(strings, str, &idx)) {
+		idx = NUM_PACK(addObject(image, str));
+		tableSet(strings, str, idx);
+	}
+
+	return NUM_UNPACK(idx);
+}
+
+/** Appends the code of the (verified) module to the image, with its pool indices
+ * replaced by the ones of the image. The image is always byte-encoded. 'lines'
+ * holds the line of every code byte of the module.
+ * @returns bool: false if a 'mulhi' multiplier lands beyond its 16-bit index. */
+static bool
+linkCode(ByteCode* module, const uint32_t* lines, ByteCode* image, uint32_t* constMap, uint32_t* objMap)
+{
+	for (uint32_t offset = 0; offset < module->count;) {
+		uint8_t opCode = module->code[offset];
+		const OpInfo* info = &opInfo[opCode];
+		uint32_t line = lines[offset];
+		uint32_t operand = readOperand(module, offset);
+
+		switch (info->operand) {
+			case opnd_none:
+			case opnd_imm:
+			case opnd_count:
+			case opnd_shift:
+				writeByteCode(image, opCode, line);
+				for (uint32_t i = info->width; i > 0; --i)
+					writeByteCode(image, (uint8_t)(operand >> (8 * (i - 1))), line);
+			break;
+			case opnd_const:
+				writeIndexed(image, op_iconst, op_iconstw, op_iconstl, constMap[operand], line);
+			break;
+			case opnd_object:
+				writeIndexed(image, op_obj_str, op_obj_strw, op_obj_strl, objMap[operand], line);
+			break;
+			case opnd_magic:
+				if (constMap[operand >> 8] > UINT16_MAX) {
+					fprintf(stderr, "Linked image can't address the multiplier of '%s'.\n", info->name);
+					return false;
+				}
+
+				writeByteCode(image, opCode, line);
+				writeByteCode(image, (uint8_t)(constMap[operand >> 8] >> 8), line);
+				writeByteCode(image, (uint8_t)constMap[operand >> 8], line);
+				writeByteCode(image, (uint8_t)operand, line);
+			break;
+		}
+
+		offset += instructionSize(module, opCode);
+	}
+
+	return true;
+}
+
+/**
+ * Links the given (verified) modules into one image, which runs them one after
+ * another. Equal constants and strings of all the modules share one pool entry,
+ * the instructions which reference them are rewritten to the new indices.
+ * @returns bool: false if the image needs more pool entries than operands can address.
+ */
+bool
+linkModules(ByteCode* modules, uint32_t count, ByteCode* image)
+{
+	ConstIndex constIndex;
+	Table strings;
+	Table interned;
+	Obj* objects = NULL;
+	StringSet set = { &interned, &objects };	// The image's pool keeps copies of the strings.
+	bool result = true;
+
+	initConstIndex(&constIndex);
+	initTable(&strings);
+	initTable(&interned);
+	for (uint32_t m = 0; m < count && result; ++m) {
+		ByteCode* module = &modules[m];
+		uint32_t* constMap = ALLOCATE(uint32_t, module->constants.count);
+		uint32_t* objMap   = ALLOCATE(uint32_t, module->objects.count);
+
+		for (uint32_t i = 0; i < module->constants.count; ++i)
+			constMap[i] = internConst(&constIndex, &image->constants, module->constants.values[i]);
+
+		for (uint32_t i = 0; i < module->objects.count; ++i)
+			objMap[i] = linkString(&set, &strings, image, &module->objects, i);
+
+		if (image->constants.count > MAX_POOL_ENTRIES || image->objects.count > MAX_POOL_ENTRIES) {
+			fprintf(stderr, "Linked image needs more than %d constants or strings.\n", MAX_POOL_ENTRIES);
+			result = false;
+		} else {
+			// Decoding the line table once keeps linking linear in the size of the code.
+			uint32_t* lines = ALLOCATE(uint32_t, module->count);
+			expandLineTable(&module->lines, lines, module->count);
+			result = linkCode(module, lines, image, constMap, objMap);
+			FREE_ARRAY(uint32_t, lines, module->count);
+		}
+
+		FREE_ARRAY(uint32_t, constMap, module->constants.count);
+		FREE_ARRAY(uint32_t, objMap, module->objects.count);
+	}
+
+	freeConstIndex(&constIndex);
+	freeTable(&strings);
+	freeTable(&interned);
+	freeObjectList(objects);
+	return result;
+}
\ No newline at end of file
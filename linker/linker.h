@@ -0,0 +1,9 @@
+#ifndef FUNVM_LINKER_H
+#define FUNVM_LINKER_H
+
+#include "common.h"
+#include "bytecode.h"
+
+bool linkModules(ByteCode* modules, uint32_t count, ByteCode* image);
+
+#endif /* FUNVM_LINKER_H */
\ No newline at end of file
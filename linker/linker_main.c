@@ -0,0 +1,57 @@
+#include "common.h"
+#include "memory.h"
+#include "module.h"
+#include "verifier.h"
+#include "linker.h"
+
+static void
+usage(void)
+{
+	printf("Usage:\n\tFVMlink <image.fvb> <module.fvb>...\n");
+	printf("\tThe image runs the modules one after another, in the given order.\n");
+	exit(1);
+}
+
+int
+main(int argc, char* argv[])
+{
+	if (argc < 3)
+		usage();
+#if defined(FUNVM_MEM_MANAGER)
+	heapInit();
+#endif
+	uint32_t count = (uint32_t)(argc - 2);
+	uint32_t constants = 0;
+	uint32_t objects = 0;
+	ByteCode* modules = ALLOCATE(ByteCode, count);
+	ByteCode image;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		initByteCode(&modules[i]);
+		if (!readModule(argv[i + 2], &modules[i]))
+			exit(74);
+
+		if (!verifyByteCode(&modules[i])) {
+			fprintf(stderr, "Binary file '%s' is malformed.\n", argv[i + 2]);
+			exit(74);
+		}
+
+		constants += modules[i].constants.count;
+		objects   += modules[i].objects.count;
+	}
+
+	initByteCode(&image);
+	if (!linkModules(modules, count, &image) || !writeModule(argv[1], &image, NULL))
+		exit(74);
+
+	printf("Linked %d modules: %d -> %d constants, %d -> %d strings.\n", count,
+		constants, image.constants.count, objects, image.objects.count);
+
+	for (uint32_t i = 0; i < count; ++i)
+		freeByteCode(&modules[i]);
+
+	freeByteCode(&image);
+	FREE_ARRAY(ByteCode, modules, count);
+	freeObjects();
+	return (0);
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "common.h"
+#include "memory.h"
+#include "compiler.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ASSERT_TRUE(expr)								\
+	do {												\
+		if (!(expr)) {									\
+			printf("ERROR: at line %d\n", __LINE__);	\
+			exit(1);									\
+		}												\
+	} while (0)
+
+/** Compiles the source from a page of its own with an inaccessible page right after
+ * it, the way a mapped source file of exactly one page ends.
+ * @returns bool: true if it compiles and its only constant is 'expected'. */
+static bool
+compileAtPageEnd(const char* text, i32 expected)
+{
+	long pageSize = sysconf(_SC_PAGESIZE);
+	char* page = mmap(NULL, pageSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_TRUE(page != MAP_FAILED);
+	ASSERT_TRUE(mprotect(page + pageSize, pageSize, PROT_NONE) == 0);
+
+	// Pad the front with blanks, so that the text ends at the end of the page.
+	uint32_t length = (uint32_t)strlen(text);
+	memset(page, ' ', pageSize - length);
+	memcpy(page + pageSize - length, text, length);
+
+	ByteCode bCode;
+	initByteCode(&bCode);
+	bool result = compile(page, (uint32_t)pageSize, &bCode, false) && bCode.constants.count == 1 &&
+		NUM_UNPACK(bCode.constants.values[0]) == expected;
+
+	freeByteCode(&bCode);
+	munmap(page, pageSize * 2);
+	return result;
+}
+
+/** Writes 'count' nested additions of 1 into 'buffer', a sum the compiler can't
+ * fold once there are more of them than the constants it holds back. */
+static char*
+writeNestedSum(char* buffer, uint32_t count)
+{
+	buffer[0] = '\0';
+	for (uint32_t i = 0; i < count; ++i)
+		strcat(buffer, "(1 + ");
+
+	strcat(buffer, "1");
+	for (uint32_t i = 0; i < count; ++i)
+		strcat(buffer, ")");
+
+	return buffer;
+}
+
+/** Compiles the source, made of up to three parts, into 'bCode'. */
+static bool
+compileParts(ByteCode* bCode, const char* first, const char* second, const char* third)
+{
+	char source[4096];
+	snprintf(source, sizeof(source), "%s%s%s", first, second, third);
+	initByteCode(bCode);
+	return compile(source, (uint32_t)strlen(source), bCode, false);
+}
+
+/** @returns uint32_t: how many times the instruction occurs in the code. */
+static uint32_t
+countOp(ByteCode* bCode, OpCode op)
+{
+	uint32_t count = 0;
+	for (uint32_t offset = 0; offset < bCode->count; offset += instructionSize(bCode, bCode->code[offset]))
+		count += (bCode->code[offset] == op);
+
+	return count;
+}
+
+int
+main(int argc, char* argv[])
+{
+#if defined(FUNVM_MEM_MANAGER)
+	heapInit();
+#endif
+
+	// A number which ends the source is read within its token.
+	ASSERT_TRUE(compileAtPageEnd("1 + 12345678", 12345679));
+	ASSERT_TRUE(compileAtPageEnd("100000 +\n\t7654321", 7754321));
+	ASSERT_TRUE(compileAtPageEnd("(100000)", 100000));
+
+	// Literals beyond the range of an i32 saturate.
+	ASSERT_TRUE(compileAtPageEnd("99999999999", INT32_MAX));
+
+	// A sum the folder gives up on, so that the operators applied to it are emitted.
+	char sum[1024];
+	ByteCode bCode;
+	writeNestedSum(sum, MAX_PENDING + 1);
+
+	ASSERT_TRUE(compileParts(&bCode, "(", sum, ") * 8"));
+	ASSERT_TRUE(countOp(&bCode, op_shl) == 1 && countOp(&bCode, op_mul_i32) == 0);
+	freeByteCode(&bCode);
+
+	ASSERT_TRUE(compileParts(&bCode, "(", sum, ") / -4"));
+	ASSERT_TRUE(countOp(&bCode, op_sar) == 1 && countOp(&bCode, op_negate) == 1 && countOp(&bCode, op_div) == 0);
+	freeByteCode(&bCode);
+
+	ASSERT_TRUE(compileParts(&bCode, "(", sum, ") / 7"));
+	ASSERT_TRUE(countOp(&bCode, op_mulhi) == 1 && countOp(&bCode, op_div) == 0);
+	freeByteCode(&bCode);
+
+	// Multiplying by a constant which isn't a power of two stays a multiplication.
+	ASSERT_TRUE(compileParts(&bCode, "(", sum, ") * 7"));
+	ASSERT_TRUE(countOp(&bCode, op_mul_i32) == 1);
+	freeByteCode(&bCode);
+
+	// The repeated sum is computed once and copied.
+	ASSERT_TRUE(compileParts(&bCode, sum, "", ""));
+	uint32_t adds = countOp(&bCode, op_add_i32);
+	freeByteCode(&bCode);
+
+	char repeated[2 * sizeof(sum) + 16];
+	snprintf(repeated, sizeof(repeated), "(%s + 1) * (%s + 1)", sum, sum);
+	ASSERT_TRUE(compileParts(&bCode, repeated, "", ""));
+	ASSERT_TRUE(countOp(&bCode, op_add_i32) == adds + 1 && countOp(&bCode, op_dup) == 1);
+	freeByteCode(&bCode);
+
+	printf("test\n\t%s\nresult\n\tSUCCESS\n", __FILE__);
+	return 0;
+}
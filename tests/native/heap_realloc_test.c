@@ -4,7 +4,7 @@
 #include "common.h"
 #include "memory.h"
 
-extern uint8_t heap[];
+extern _Thread_local uint8_t heap[];
 
 #define ASSERT_NULL(expr)								\
 	do {												\
@@ -0,0 +1,165 @@
+#include "common.h"
+#include "memory.h"
+#include "module.h"
+#include "archive.h"
+
+#define MODULE_PATH "module_test.fvb"
+#define ARCHIVE_PATH "module_test.fva"
+
+#define ASSERT_TRUE(expr)								\
+	do {												\
+		if (!(expr)) {									\
+			printf("ERROR: at line %d\n", __LINE__);	\
+			exit(1);									\
+		}												\
+	} while (0)
+
+static void
+fillByteCode(ByteCode* bCode)
+{
+	initByteCode(bCode);
+
+	for (uint32_t i = 0; i < 300; ++i)
+		writeByteCode(bCode, (uint8_t)i, 1 + i / 100);
+
+	addConstant(bCode, NUM_PACK(-1));
+	addConstant(bCode, NUM_PACK(INT32_MAX));
+	addConstant(bCode, NUM_PACK(INT32_MIN));
+	addObject(bCode, copyString("", 0));
+	addObject(bCode, copyString("FunVM", 5));
+}
+
+static void
+assertSame(ByteCode* expected, ByteCode* actual)
+{
+	ASSERT_TRUE(expected->count == actual->count);
+	ASSERT_TRUE(memcmp(expected->code, actual->code, expected->count) == 0);
+
+	for (uint32_t i = 0; i < expected->count; ++i)
+		ASSERT_TRUE(getLine(&actual->lines, i) == 1 + i / 100);
+	ASSERT_TRUE(getLine(&actual->lines, expected->count) == 0);
+
+	ASSERT_TRUE(expected->constants.count == actual->constants.count);
+	for (uint32_t i = 0; i < expected->constants.count; ++i)
+		ASSERT_TRUE(valuesEqual(expected->constants.values[i], actual->constants.values[i]));
+
+	ASSERT_TRUE(expected->objects.count == actual->objects.count);
+	for (uint32_t i = 0; i < expected->objects.count; ++i) {
+		PoolString* a = &expected->objects.entries[i];
+		PoolString* b = &actual->objects.entries[i];
+		ASSERT_TRUE(a->len == b->len);
+		ASSERT_TRUE(a->hash == b->hash);
+		ASSERT_TRUE(strcmp(OBJPOOL_STR_CHARS(&expected->objects, i),
+						   OBJPOOL_STR_CHARS(&actual->objects, i)) == 0);
+	}
+}
+
+static void
+testArchive(ByteCode* written, bool mapped)
+{
+	const char* names[] = { "first", "second" };
+	ByteCode modules[2];
+	ByteCode read;
+	Archive archive;
+
+	// Both modules have the same strings, which the archive keeps once.
+	modules[0] = *written;
+	modules[1] = *written;
+	ASSERT_TRUE(writeArchive(ARCHIVE_PATH, names, modules, 2));
+	ASSERT_TRUE(openArchive(&archive, ARCHIVE_PATH, mapped));
+	ASSERT_TRUE(archive.moduleCount == 2);
+	ASSERT_TRUE(archive.stringsSize == written->objects.size);
+
+	for (uint32_t i = 0; i < 2; ++i) {
+		initByteCode(&read);
+		ASSERT_TRUE(loadArchiveModule(&archive, names[i], &read));
+		assertSame(written, &read);
+		freeByteCode(&read);
+	}
+
+	initByteCode(&read);
+	ASSERT_TRUE(!loadArchiveModule(&archive, "third", &read));
+	closeArchive(&archive);
+	remove(ARCHIVE_PATH);
+}
+
+static void
+corruptByte(long offset)
+{
+	FILE* file = fopen(MODULE_PATH, "r+b");
+	ASSERT_TRUE(file != NULL);
+	fseek(file, offset, SEEK_SET);
+	int byte = fgetc(file);
+	fseek(file, offset, SEEK_SET);
+	fputc(byte ^ 0xFF, file);
+	fclose(file);
+}
+
+int
+main(int argc, char* argv[])
+{
+	ByteCode written;
+	ByteCode read;
+#if defined(FUNVM_MEM_MANAGER)
+	heapInit();
+#endif
+
+	fillByteCode(&written);
+	ASSERT_TRUE(writeModule(MODULE_PATH, &written, NULL));
+
+	initByteCode(&read);
+	ASSERT_TRUE(readModule(MODULE_PATH, &read));
+	assertSame(&written, &read);
+	freeByteCode(&read);
+
+	ASSERT_TRUE(mapModule(MODULE_PATH, &read));
+	assertSame(&written, &read);
+	freeByteCode(&read);
+
+	testArchive(&written, false);
+	testArchive(&written, true);
+
+	// The build key is optional and doesn't change how the module loads.
+	BuildKey key = { 0x0123456789ABCDEFull, 42, 0x000104, 1 };
+	BuildKey readKey;
+	ASSERT_TRUE(!readBuildKey(MODULE_PATH, &readKey));
+	ASSERT_TRUE(!readBuildKey("missing.fvb", &readKey));
+
+	ASSERT_TRUE(writeModule(MODULE_PATH, &written, &key));
+	ASSERT_TRUE(readBuildKey(MODULE_PATH, &readKey));
+	ASSERT_TRUE(readKey.sourceHash == key.sourceHash && readKey.sourceSize == key.sourceSize);
+	ASSERT_TRUE(readKey.compiler == key.compiler && readKey.options == key.options);
+
+	initByteCode(&read);
+	ASSERT_TRUE(readModule(MODULE_PATH, &read));
+	assertSame(&written, &read);
+	freeByteCode(&read);
+	ASSERT_TRUE(writeModule(MODULE_PATH, &written, NULL));
+
+	// A container which doesn't get the sections it reserved isn't written at all.
+	ContainerWriter writer;
+	ASSERT_TRUE(!beginContainer(&writer, MODULE_PATH, FVB_MAX_SECTIONS + 1));
+	ASSERT_TRUE(beginContainer(&writer, MODULE_PATH, 2));
+	beginSection(&writer, sec_code);
+	endSection(&writer);
+	ASSERT_TRUE(!endContainer(&writer, MODULE_PATH, FVB_MAGIC, FVB_VERSION_MAJOR, FVB_VERSION_MINOR));
+	ASSERT_TRUE(readModule(MODULE_PATH, &read));
+	assertSame(&written, &read);
+	freeByteCode(&read);
+
+	// A damaged header, section table or section data must be rejected.
+	corruptByte(0);
+	ASSERT_TRUE(!readModule(MODULE_PATH, &read));
+	corruptByte(0);
+
+	corruptByte(FVB_HEADER_SIZE + 4);
+	ASSERT_TRUE(!readModule(MODULE_PATH, &read));
+	corruptByte(FVB_HEADER_SIZE + 4);
+
+	corruptByte(FVB_HEADER_SIZE + 3 * FVB_SECTION_SIZE + 8);
+	ASSERT_TRUE(!readModule(MODULE_PATH, &read));
+
+	freeByteCode(&written);
+	remove(MODULE_PATH);
+	printf("test\n\t%s\nresult\n\tSUCCESS\n", __FILE__);
+}
\ No newline at end of file
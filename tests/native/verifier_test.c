@@ -0,0 +1,166 @@
+#include "common.h"
+#include "memory.h"
+#include "verifier.h"
+#include "byte_order.h"
+
+#define ASSERT_TRUE(expr)								\
+	do {												\
+		if (!(expr)) {									\
+			printf("ERROR: at line %d\n", __LINE__);	\
+			exit(1);									\
+		}												\
+	} while (0)
+
+/** Builds a module out of the given code and runs the verifier on it. */
+static bool
+verify(const uint8_t* code, uint32_t count, uint32_t* maxStack)
+{
+	ByteCode bCode;
+	initByteCode(&bCode);
+	addObject(&bCode, copyString("str", 3));
+	addConstant(&bCode, NUM_PACK(0x55555556));
+	addConstant(&bCode, NULL_PACK());
+
+	for (uint32_t i = 0; i < count; ++i)
+		writeByteCode(&bCode, code[i], 1);
+
+	bool result = verifyByteCode(&bCode);
+	if (maxStack != NULL)
+		*maxStack = bCode.maxStack;
+
+	freeByteCode(&bCode);
+	return result;
+}
+
+/** Same as 'verify', for code in instruction words. */
+static bool
+verifyWords(const uint32_t* words, uint32_t count)
+{
+	ByteCode bCode;
+	initByteCode(&bCode);
+	addObject(&bCode, copyString("str", 3));
+	addConstant(&bCode, NUM_PACK(0x55555556));
+	addConstant(&bCode, NULL_PACK());
+	bCode.encoding = enc_words;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint8_t word[INSTRUCTION_WORD];
+		storeU32(word, words[i]);
+		for (uint32_t j = 0; j < INSTRUCTION_WORD; ++j)
+			writeByteCode(&bCode, word[j], 1);
+	}
+
+	bool result = verifyByteCode(&bCode);
+	freeByteCode(&bCode);
+	return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+	uint32_t maxStack;
+#if defined(FUNVM_MEM_MANAGER)
+	heapInit();
+#endif
+
+	const uint8_t sum[] = { op_one, op_push_i8, 2, op_push_i16, 1, 0, op_add_i32, op_add_i32, op_ret };
+	ASSERT_TRUE(verify(sum, sizeof(sum), &maxStack));
+	ASSERT_TRUE(maxStack == 3);
+
+	// The result of 'negate' is a number whenever the instruction succeeds.
+	const uint8_t negated[] = { op_obj_str, 0, op_negate, op_one, op_sub_i32, op_ret };
+	ASSERT_TRUE(verify(negated, sizeof(negated), NULL));
+
+	const uint8_t concat[] = { op_obj_str, 0, op_obj_str, 0, op_concat_str, op_ret };
+	ASSERT_TRUE(verify(concat, sizeof(concat), NULL));
+
+	const uint8_t concatN[] = { op_obj_str, 0, op_obj_str, 0, op_obj_str, 0, op_concat, 3, op_ret };
+	ASSERT_TRUE(verify(concatN, sizeof(concatN), &maxStack));
+	ASSERT_TRUE(maxStack == 3);
+
+	const uint8_t concatOne[] = { op_obj_str, 0, op_concat, 1, op_ret };
+	ASSERT_TRUE(!verify(concatOne, sizeof(concatOne), NULL));
+
+	const uint8_t concatDeep[] = { op_obj_str, 0, op_obj_str, 0, op_concat, 3, op_ret };
+	ASSERT_TRUE(!verify(concatDeep, sizeof(concatDeep), NULL));
+
+	// Specialized instructions must be proven to get operands of their types.
+	const uint8_t wrongType[] = { op_obj_str, 0, op_one, op_add_i32, op_ret };
+	ASSERT_TRUE(!verify(wrongType, sizeof(wrongType), NULL));
+
+	const uint8_t unknownType[] = { op_obj_str, 0, op_one, op_add, op_one, op_add_i32, op_ret };
+	ASSERT_TRUE(!verify(unknownType, sizeof(unknownType), NULL));
+
+	const uint8_t wrongConcat[] = { op_one, op_obj_str, 0, op_concat_str, op_ret };
+	ASSERT_TRUE(!verify(wrongConcat, sizeof(wrongConcat), NULL));
+
+	const uint8_t wrongConcatN[] = { op_obj_str, 0, op_one, op_obj_str, 0, op_concat, 3, op_ret };
+	ASSERT_TRUE(!verify(wrongConcatN, sizeof(wrongConcatN), NULL));
+
+	const uint8_t wideLoads[] = { op_iconstl, 0, 0, 0, op_obj_strl, 0, 0, 0, op_concat, 2, op_ret };
+	ASSERT_TRUE(!verify(wideLoads, sizeof(wideLoads), NULL));
+
+	const uint8_t longLoads[] = { op_iconstl, 0, 0, 0, op_obj_strl, 0, 0, 0, op_eq, op_ret };
+	ASSERT_TRUE(verify(longLoads, sizeof(longLoads), NULL));
+
+	const uint8_t longObject[] = { op_obj_strl, 1, 0, 0, op_ret };
+	ASSERT_TRUE(!verify(longObject, sizeof(longObject), NULL));
+
+	const uint8_t shifts[] = { op_push_i8, 9, op_shl, 31, op_sar, 1, op_mulhi, 0, 0, MAGIC_ADD | 3, op_ret };
+	ASSERT_TRUE(verify(shifts, sizeof(shifts), NULL));
+
+	const uint8_t noShift[] = { op_one, op_shl, 0, op_ret };
+	ASSERT_TRUE(!verify(noShift, sizeof(noShift), NULL));
+
+	const uint8_t wideShift[] = { op_one, op_sar, 32, op_ret };
+	ASSERT_TRUE(!verify(wideShift, sizeof(wideShift), NULL));
+
+	const uint8_t badMagic[] = { op_one, op_mulhi, 0, 1, 0, op_ret };
+	ASSERT_TRUE(!verify(badMagic, sizeof(badMagic), NULL));
+
+	const uint8_t badFlags[] = { op_one, op_mulhi, 0, 0, 0x40, op_ret };
+	ASSERT_TRUE(!verify(badFlags, sizeof(badFlags), NULL));
+
+	const uint8_t shiftString[] = { op_obj_str, 0, op_shl, 1, op_ret };
+	ASSERT_TRUE(!verify(shiftString, sizeof(shiftString), NULL));
+
+	// Stack shuffles keep the types of the values.
+	const uint8_t shuffled[] = { op_obj_str, 0, op_one, op_swap, op_dup, op_concat_str, op_over, op_add_i32, op_ret };
+	ASSERT_TRUE(!verify(shuffled, sizeof(shuffled), NULL));
+
+	const uint8_t copied[] = { op_obj_str, 0, op_one, op_swap, op_dup, op_concat_str, op_ret };
+	ASSERT_TRUE(verify(copied, sizeof(copied), &maxStack));
+	ASSERT_TRUE(maxStack == 3);
+
+	const uint8_t wrongCopy[] = { op_obj_str, 0, op_one, op_dup, op_concat_str, op_ret };
+	ASSERT_TRUE(!verify(wrongCopy, sizeof(wrongCopy), NULL));
+
+	const uint8_t underflow[] = { op_one, op_add, op_ret };
+	ASSERT_TRUE(!verify(underflow, sizeof(underflow), NULL));
+
+	const uint8_t badObject[] = { op_obj_str, 1, op_ret };
+	ASSERT_TRUE(!verify(badObject, sizeof(badObject), NULL));
+
+	const uint8_t truncated[] = { op_one, op_push_i16, 0 };
+	ASSERT_TRUE(!verify(truncated, sizeof(truncated), NULL));
+
+	const uint8_t noReturn[] = { op_one };
+	ASSERT_TRUE(!verify(noReturn, sizeof(noReturn), NULL));
+
+	const uint8_t unknownOp[] = { op_count, op_ret };
+	ASSERT_TRUE(!verify(unknownOp, sizeof(unknownOp), NULL));
+
+	const uint32_t words[] = { op_push_i8 | (0xFF << 8), op_iconst | (0 << 8), op_add, op_ret };
+	ASSERT_TRUE(verifyWords(words, sizeof(words) / sizeof(words[0])));
+
+	const uint32_t wideWord[] = { op_iconstw | (0 << 8), op_ret };
+	ASSERT_TRUE(!verifyWords(wideWord, sizeof(wideWord) / sizeof(wideWord[0])));
+
+	const uint32_t longWord[] = { op_obj_strl | (0 << 8), op_ret };
+	ASSERT_TRUE(!verifyWords(longWord, sizeof(longWord) / sizeof(longWord[0])));
+
+	const uint32_t wideImm[] = { op_push_i8 | (0x100 << 8), op_ret };
+	ASSERT_TRUE(!verifyWords(wideImm, sizeof(wideImm) / sizeof(wideImm[0])));
+
+	printf("test\n\t%s\nresult\n\tSUCCESS\n", __FILE__);
+}
\ No newline at end of file
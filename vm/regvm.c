@@ -0,0 +1,337 @@
+#include "regvm.h"
+#include "object.h"
+#include "globals.h"
+
+/* State of the translation: the stack of the stack machine, with the slot which
+ * holds each value instead of the value. */
+typedef struct {
+	ByteCode*  bCode;
+	RegCode*   rCode;
+	uint32_t   registers;	/* <! one more than the deepest stack, see allocRegister(). */
+	uint32_t   constBase;	/* <! slot of the first constant of the pool. */
+	uint32_t   immBase;		/* <! slot of the first immediate value. */
+	uint32_t*  stack;
+	uint32_t   depth;
+	uint32_t*  refs;		/* <! number of stack values each register holds. */
+	ConstPool  immediates;	/* <! values the instructions themselves load. */
+	ConstIndex immIndex;
+} Translator;
+
+static void
+pushSlot(Translator* t, uint32_t slot)
+{
+	if (slot < t->registers)
+		t->refs[slot]++;
+
+	t->stack[t->depth++] = slot;
+}
+
+static bool
+pushImmediate(Translator* t, Value value)
+{
+	uint32_t slot = t->immBase + internConst(&t->immIndex, &t->immediates, value);
+	if (slot > UINT16_MAX)
+		return false;
+
+	pushSlot(t, slot);
+	return true;
+}
+
+/** @returns uint32_t: a register no value on the stack is in, preferably the one
+ * of the stack slot the result goes to. Values in registers are fewer than the
+ * stack is deep, so there's always one. */
+static uint32_t
+allocRegister(Translator* t)
+{
+	if (t->refs[t->depth] == 0)
+		return t->depth;
+
+	uint32_t reg = 0;
+	while (t->refs[reg] != 0)
+		reg++;
+
+	return reg;
+}
+
+/** Emits the three-address form of an instruction which computes a value out of
+ * the ones on top of the stack, or consumes one ('ret').
+ * @returns bool: false if the operands of 'concat' can't be addressed anymore. */
+static bool
+emitOperation(Translator* t, uint8_t op, uint32_t operand, uint32_t offset)
+{
+	const OpInfo* info = &opInfo[op];
+	RegCode* rCode = t->rCode;
+	RegIns* ins = &rCode->code[rCode->count];
+	uint32_t pops = (info->operand == opnd_count) ? operand : info->pops;
+
+	rCode->offsets[rCode->count++] = offset;
+	ins->op = op;
+	ins->flags = 0;
+	ins->dst = 0;
+	ins->a = 0;
+	ins->b = 0;
+
+	t->depth -= pops;
+	uint32_t* operands = &t->stack[t->depth];
+	for (uint32_t i = 0; i < pops; ++i) {
+		if (operands[i] < t->registers)
+			t->refs[operands[i]]--;
+	}
+
+	switch (info->operand) {
+		case opnd_count:
+			if (rCode->argCount > UINT16_MAX)
+				return false;
+
+			ins->a = (uint16_t)rCode->argCount;
+			ins->b = (uint16_t)pops;
+			for (uint32_t i = 0; i < pops; ++i)
+				rCode->args[rCode->argCount++] = (uint16_t)operands[i];
+		break;
+		case opnd_shift:
+			ins->a = (uint16_t)operands[0];
+			ins->flags = (uint8_t)operand;
+		break;
+		case opnd_magic:
+			ins->a = (uint16_t)operands[0];
+			ins->b = (uint16_t)(t->constBase + (operand >> 8));
+			ins->flags = (uint8_t)operand;
+		break;
+		default:
+			ins->a = (pops > 0) ? (uint16_t)operands[0] : 0;
+			ins->b = (pops > 1) ? (uint16_t)operands[1] : 0;
+		break;
+	}
+
+	if (info->pushes == 1) {
+		ins->dst = (uint16_t)allocRegister(t);
+		pushSlot(t, ins->dst);
+	}
+
+	return true;
+}
+
+/** @returns bool: false if the code loads more values than slots can address. */
+static bool
+translateCode(Translator* t)
+{
+	ByteCode* bCode = t->bCode;
+
+	for (uint32_t offset = 0; offset < bCode->count;) {
+		uint8_t op = bCode->code[offset];
+		uint32_t operand = readOperand(bCode, offset);
+		bool result = true;
+
+		switch (op) {
+			case op_iconst:
+			case op_iconstw:
+			case op_iconstl:   pushSlot(t, t->constBase + operand); break;
+			case op_obj_str:
+			case op_obj_strw:
+			case op_obj_strl:  pushSlot(t, t->registers + operand); break;
+			case op_null:      result = pushImmediate(t, NULL_PACK()); break;
+			case op_true:      result = pushImmediate(t, BOOL_PACK(true)); break;
+			case op_false:     result = pushImmediate(t, BOOL_PACK(false)); break;
+			case op_zero:      result = pushImmediate(t, NUM_PACK(0)); break;
+			case op_one:       result = pushImmediate(t, NUM_PACK(1)); break;
+			case op_push_i8:   result = pushImmediate(t, NUM_PACK((int8_t)operand)); break;
+			case op_push_i16:  result = pushImmediate(t, NUM_PACK((int16_t)operand)); break;
+			case op_dup:       pushSlot(t, t->stack[t->depth - 1]); break;
+			case op_over:      pushSlot(t, t->stack[t->depth - 2]); break;
+			case op_swap: {
+				uint32_t top = t->stack[t->depth - 1];
+				t->stack[t->depth - 1] = t->stack[t->depth - 2];
+				t->stack[t->depth - 2] = top;
+			} break;
+			default:
+				result = emitOperation(t, op, operand, offset);
+			break;
+		}
+
+		if (!result)
+			return false;
+
+		offset += instructionSize(bCode, op);
+	}
+
+	return true;
+}
+
+/**
+ * Translates verified bytecode into three-address code for the register backend.
+ * The stack machine's code is a post-order walk of its expression trees, and the
+ * verifier has proven how deep the stack gets, so every value gets the register of
+ * the stack slot it would be in. Loaded values are never copied: the slots of the
+ * register file which hold them are used as operands right away.
+ * @returns bool: false if the code needs more than UINT16_MAX + 1 slots.
+ */
+bool
+translateRegisters(ByteCode* bCode, RegCode* rCode)
+{
+	Translator t;
+	t.bCode = bCode;
+	t.rCode = rCode;
+	t.registers = bCode->maxStack + 1;
+	t.constBase = t.registers + bCode->objects.count;
+	t.immBase = t.constBase + bCode->constants.count;
+	t.depth = 0;
+	rCode->code = NULL;
+	rCode->offsets = NULL;
+	rCode->args = NULL;
+	rCode->slots = NULL;
+	rCode->count = 0;
+	rCode->capacity = 0;
+	rCode->slotCount = 0;
+	rCode->argCount = 0;
+	if (t.immBase > UINT16_MAX)
+		return false;
+
+	resolveStrings(bCode);
+	t.stack = ALLOCATE(uint32_t, bCode->maxStack + 1);
+	t.refs = ALLOCATE(uint32_t, t.registers);
+	memset(t.refs, 0, sizeof(uint32_t) * t.registers);
+	initConstPool(&t.immediates);
+	initConstIndex(&t.immIndex);
+
+	// Every instruction becomes one at most, 'concat' has fewer operands than bytes.
+	rCode->capacity = bCode->count;
+	rCode->code = ALLOCATE(RegIns, rCode->capacity);
+	rCode->offsets = ALLOCATE(uint32_t, rCode->capacity);
+	rCode->args = ALLOCATE(uint16_t, rCode->capacity);
+
+	bool result = translateCode(&t);
+	if (result) {
+		rCode->slotCount = t.immBase + t.immediates.count;
+		rCode->slots = ALLOCATE(Value, rCode->slotCount);
+
+		for (uint32_t i = 0; i < t.registers; ++i)
+			rCode->slots[i] = NULL_PACK();
+
+		for (uint32_t i = 0; i < bCode->objects.count; ++i)
+			rCode->slots[t.registers + i] = OBJ_PACK(bCode->strings[i]);
+
+		memcpy(&rCode->slots[t.constBase], bCode->constants.values, sizeof(Value) * bCode->constants.count);
+		memcpy(&rCode->slots[t.immBase], t.immediates.values, sizeof(Value) * t.immediates.count);
+	} else {
+		freeRegCode(rCode);
+	}
+
+	FREE_ARRAY(uint32_t, t.stack, bCode->maxStack + 1);
+	FREE_ARRAY(uint32_t, t.refs, t.registers);
+	freeConstPool(&t.immediates);
+	freeConstIndex(&t.immIndex);
+	return result;
+}
+
+void
+freeRegCode(RegCode* rCode)
+{
+	FREE_ARRAY(RegIns, rCode->code, rCode->capacity);
+	FREE_ARRAY(uint32_t, rCode->offsets, rCode->capacity);
+	FREE_ARRAY(uint16_t, rCode->args, rCode->capacity);
+	FREE_ARRAY(Value, rCode->slots, rCode->slotCount);
+	rCode->code = NULL;
+	rCode->offsets = NULL;
+	rCode->args = NULL;
+	rCode->slots = NULL;
+	rCode->count = 0;
+	rCode->capacity = 0;
+	rCode->slotCount = 0;
+	rCode->argCount = 0;
+}
+
+/* Operands of the specialized instructions are proven numbers by the verifier. */
+#define BINARY_I32(packer, op)											\
+	slots[ins->dst] = packer(NUM_UNPACK(slots[ins->a]) op NUM_UNPACK(slots[ins->b]))
+
+/* The arithmetic wraps around on overflow like the compiler's folding: it's done on
+ * uint32_t, where that's defined. */
+#define ARITH_I32(op)													\
+	slots[ins->dst] = NUM_PACK((i32)((uint32_t)NUM_UNPACK(slots[ins->a]) op (uint32_t)NUM_UNPACK(slots[ins->b])))
+
+/**
+ * Runs code translated by translateRegisters() out of the given bytecode. The
+ * results are the same the stack backend gets, errors are reported at the same
+ * lines.
+ */
+InterpretResult
+runRegisters(ByteCode* bCode, RegCode* rCode)
+{
+	Value* slots = rCode->slots;
+	RegIns* end = rCode->code + rCode->count;
+
+	vm.bCode = bCode;
+	for (RegIns* ins = rCode->code; ins < end; ++ins) {
+		switch (ins->op) {
+			case op_eq:  slots[ins->dst] = BOOL_PACK(valuesEqual(slots[ins->a], slots[ins->b]));  break;
+			case op_neq: slots[ins->dst] = BOOL_PACK(!valuesEqual(slots[ins->a], slots[ins->b])); break;
+			case op_gt:
+			case op_lt:
+			case op_ge:
+			case op_le:
+			case op_add:
+			case op_sub:
+			case op_mul:
+			case op_div:
+			{
+				const char* error = binaryValues(ins->op, slots[ins->a], slots[ins->b], &slots[ins->dst]);
+				if (error != NULL) {
+					runtimeErrorAt(rCode->offsets[ins - rCode->code], "%s", error);
+					return INTERPRET_RUNTIME_ERROR;
+				}
+			} break;
+			case op_add_i32: ARITH_I32(+);  break;
+			case op_sub_i32: ARITH_I32(-);  break;
+			case op_mul_i32: ARITH_I32(*);  break;
+			case op_gt_i32:  BINARY_I32(BOOL_PACK, >);  break;
+			case op_lt_i32:  BINARY_I32(BOOL_PACK, <);  break;
+			case op_ge_i32:  BINARY_I32(BOOL_PACK, >=); break;
+			case op_le_i32:  BINARY_I32(BOOL_PACK, <=); break;
+			case op_concat_str: {
+				Value pieces[2] = { slots[ins->a], slots[ins->b] };
+				slots[ins->dst] = OBJ_PACK(concatStrings(pieces, 2));
+			} break;
+			case op_concat: {
+				Value pieces[UINT8_MAX];
+				for (uint32_t i = 0; i < ins->b; ++i)
+					pieces[i] = slots[rCode->args[ins->a + i]];
+
+				slots[ins->dst] = OBJ_PACK(concatStrings(pieces, ins->b));
+			} break;
+			case op_shl:
+				slots[ins->dst] = NUM_PACK((i32)((uint32_t)NUM_UNPACK(slots[ins->a]) << ins->flags));
+			break;
+			case op_sar: {
+				// Biasing a negative dividend by 2^shift - 1 rounds toward zero.
+				i32 x = NUM_UNPACK(slots[ins->a]);
+				slots[ins->dst] = NUM_PACK((i32)(x + (i32)((uint32_t)(x >> 31) >> (32 - ins->flags))) >> ins->flags);
+			} break;
+			case op_mulhi: {
+				i32 magic = NUM_UNPACK(slots[ins->b]);
+				slots[ins->dst] = NUM_PACK(divideByMagic(NUM_UNPACK(slots[ins->a]), magic, ins->flags));
+			} break;
+			case op_not:
+				slots[ins->dst] = BOOL_PACK(isFalsey(slots[ins->a]));
+			break;
+			case op_negate:
+			{
+				if (!IS_NUM(slots[ins->a])) {
+					runtimeErrorAt(rCode->offsets[ins - rCode->code], "Operand must be a number.");
+					return INTERPRET_RUNTIME_ERROR;
+				}
+
+				slots[ins->dst] = NUM_PACK((i32)(0u - (uint32_t)NUM_UNPACK(slots[ins->a])));
+			} break;
+			case op_ret:
+				if (!vm.quiet) {
+					printValue(slots[ins->a]);
+					printf("\n");
+				}
+			break;
+			default:
+				return INTERPRET_RUNTIME_ERROR; // Unreachable, loads aren't translated.
+		}
+	}
+
+	return INTERPRET_OK;
+}
\ No newline at end of file
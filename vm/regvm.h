@@ -0,0 +1,34 @@
+#ifndef FUNVM_REGVM_H
+#define FUNVM_REGVM_H
+
+#include "common.h"
+#include "bytecode.h"
+#include "vm.h"
+
+/* A three-address instruction. Operands are slots of the register file, which
+ * holds the registers followed by every value the code loads, so loads, 'dup',
+ * 'over' and 'swap' don't need instructions of their own. */
+typedef struct {
+	uint8_t  op;	/* <! OpCode of the stack instruction it stands for. */
+	uint8_t  flags;	/* <! shift amount, the flags of 'mulhi'. */
+	uint16_t dst;	/* <! slot which gets the result. */
+	uint16_t a;		/* <! slot of the first operand, for 'concat' its index in 'args'. */
+	uint16_t b;		/* <! slot of the second operand, for 'concat' the number of operands. */
+} RegIns;
+
+typedef struct {
+	RegIns*   code;
+	uint32_t  count;
+	uint32_t  capacity;	/* <! size of 'code', 'offsets' and 'args'. */
+	uint32_t* offsets;	/* <! offset of the stack instruction each one comes from. */
+	Value*    slots;	/* <! the register file. */
+	uint32_t  slotCount;
+	uint16_t* args;		/* <! operand slots of the 'concat' instructions. */
+	uint32_t  argCount;
+} RegCode;
+
+bool translateRegisters(ByteCode* bCode, RegCode* rCode);
+void freeRegCode(RegCode* rCode);
+InterpretResult runRegisters(ByteCode* bCode, RegCode* rCode);
+
+#endif /* FUNVM_REGVM_H */
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "vm.h"
 #include "object.h"
 #include "globals.h"
+#include "byte_order.h"
 
 static void
 resetStack(void)
@@ -9,27 +10,65 @@ resetStack(void)
 	vm.stackTop = vm.stack;
 }
 
+static void
+reportError(uint32_t offset, const char* format, va_list args)
+{
+	vfprintf(stderr, format, args);
+	fputs("\n", stderr);
+
+	uint32_t line = getLine(&vm.bCode->lines, offset);
+	if (line != 0)
+		fprintf(stderr, "[line %d] in script\n", line);
+	resetStack();
+}
+
 static void
 runtimeError(const char* format, ...)
 {
 	va_list args;
 	va_start(args, format);
-	vfprintf(stderr, format, args);
+	// 'ip' has already moved past the failed instruction, none of them has an operand.
+	reportError((uint32_t)(vm.ip - vm.bCode->code) - instructionSize(vm.bCode, op_negate), format, args);
 	va_end(args);
-	fputs("\n", stderr);
+}
+
+/** Reports a runtime error of the instruction at 'offset' of the running bytecode. */
+void
+runtimeErrorAt(uint32_t offset, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	reportError(offset, format, args);
+	va_end(args);
+}
+
+/* Grows the stack up to 'size' slots. Since the code is verified, 'push()' and
+ * 'pop()' never have to check the bounds. */
+static void
+reserveStack(uint32_t size)
+{
+	if (vm.stackSize >= size)
+		return;
+
+	vm.stack = GROW_ARRAY(Value, vm.stack, vm.stackSize, size);
+	vm.stackSize = size;
 }
 
 void
 initVM(void)
 {
+	vm.stack = NULL;
+	vm.stackSize = 0;
 	resetStack();
 	vm.objects = NULL;
+	vm.quiet = false;
 	initTable(&vm.strings);
 }
 
 void
 freeVM(void)
 {
+	FREE_ARRAY(Value, vm.stack, vm.stackSize);
 	freeTable(&vm.strings);
 	freeObjects();
 }
@@ -54,118 +93,186 @@ peek(int distance)
 	return vm.stackTop[-1 - distance];
 }
 
-static bool
+bool
 isFalsey(Value value)
 {
 	return IS_NULL(value) || (IS_BOOL(value) && !BOOL_UNPACK(value));
 }
 
-static void
-concatenate(void)
+/* Concatenates the given strings in a single allocation. Only the result gets
+ * hashed and interned. */
+ObjString*
+concatStrings(const Value* pieces, uint32_t count)
 {
-	ObjString* b = STRING_UNPACK(pop());
-	ObjString* a = STRING_UNPACK(pop());
+	uint32_t len = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+		len += STRING_UNPACK(pieces[i])->len;
 
-	uint32_t len = a->len + b->len;
 	char* chars = ALLOCATE(char, len + 1);
-	memcpy(chars, a->chars, a->len);
-	memcpy(chars + a->len, b->chars, b->len);
+	char* dst = chars;
+	for (uint32_t i = 0; i < count; ++i) {
+		ObjString* piece = STRING_UNPACK(pieces[i]);
+		memcpy(dst, piece->chars, piece->len);
+		dst += piece->len;
+	}
 	chars[len] = '\0';
 
-	ObjString* result = takeString(chars, len);
-	push(OBJ_PACK(result));
+	return takeString(chars, len);
 }
 
-/* Reads the byte currently pointed at by 'ip' and
- * then advances the instruction pointer. */
-static uint8_t
-readByteCode(void)
+/* Replaces the top 'count' strings on the stack with their concatenation. */
+static void
+concatenate(uint32_t count)
 {
-	return *vm.ip++;
+	Value* pieces = vm.stackTop - count;
+	ObjString* result = concatStrings(pieces, count);
+	vm.stackTop = pieces;
+	push(OBJ_PACK(result));
 }
 
-static uint16_t
-readShortCode(void)
+/* Reads the big-endian operand of 'width' bytes that follows a byte-encoded opcode
+ * and advances 'ip' past it. */
+static inline uint32_t
+readBytes(uint8_t width)
 {
-	uint16_t idx1 = readByteCode();
-	uint16_t idx2 = readByteCode();
-	return ((idx1 << 8) | (idx2 & 0x00FF));
+	uint32_t value = 0;
+	for (uint8_t i = 0; i < width; ++i)
+		value = (value << 8) | *vm.ip++;
+
+	return value;
 }
 
-static Value
-readConst(OpCode ins)
+/**
+ * Applies a generic binary instruction to 'a' and 'b', for both backends: 'op_add'
+ * concatenates two strings, anything else needs two numbers. The arithmetic wraps
+ * around on overflow like the compiler's folding.
+ * @returns const char*: the error to report if it failed, NULL if 'result' is set.
+ */
+const char*
+binaryValues(OpCode op, Value a, Value b, Value* result)
 {
-	uint16_t idx;
-	if (ins == op_iconst)
-		idx = readByteCode();
-	else
-		idx = readShortCode();
+	if (op == op_add && IS_STRING(a) && IS_STRING(b)) {
+		Value pieces[2] = { a, b };
+		*result = OBJ_PACK(concatStrings(pieces, 2));
+		return NULL;
+	}
 
-	return vm.bCode->constants.values[idx];
-}
+	if (!IS_NUM(a) || !IS_NUM(b))
+		return "Operands must be numbers.";
 
-static ObjString*
-readObjString(OpCode ins)
-{
-	uint16_t idx;
+	i32 x = NUM_UNPACK(a);
+	i32 y = NUM_UNPACK(b);
 
-	if (ins == op_obj_str)
-		idx = readByteCode();
-	else
-		idx = readShortCode();
+	switch (op) {
+		case op_add: *result = NUM_PACK((i32)((uint32_t)x + (uint32_t)y)); break;
+		case op_sub: *result = NUM_PACK((i32)((uint32_t)x - (uint32_t)y)); break;
+		case op_mul: *result = NUM_PACK((i32)((uint32_t)x * (uint32_t)y)); break;
+		case op_div:
+			if (y == 0)
+				return "Division by zero.";
 
-	ObjString* str = (ObjString*)&vm.bCode->objects.values[idx];
-	str->chars = (char*)&vm.bCode->objects.values[idx + sizeof(ObjString)];
-	return str;
+			// INT32_MIN / -1 overflows, it wraps around instead of trapping.
+			*result = NUM_PACK(y == -1 ? (i32)(0u - (uint32_t)x) : x / y);
+		break;
+		case op_gt: *result = BOOL_PACK(x > y);  break;
+		case op_lt: *result = BOOL_PACK(x < y);  break;
+		case op_ge: *result = BOOL_PACK(x >= y); break;
+		case op_le: *result = BOOL_PACK(x <= y); break;
+		default: return "Unknown binary instruction.";
+	}
+
+	return NULL;
 }
 
 static bool
 binaryOp(OpCode opType)
 {
-	if ((opType == op_add) && IS_STRING(peek(0)) && IS_STRING(peek(1))) {
-		concatenate();
-		return true;
-	}
-	else if (!IS_NUM(peek(0)) || !IS_NUM(peek(1))) {
-		runtimeError("Operands must be numbers.");
+	Value result;
+	const char* error = binaryValues(opType, peek(1), peek(0), &result);
+	if (error != NULL) {
+		runtimeError("%s", error);
 		return false;
 	}
 
+	vm.stackTop -= 2;
+	push(result);
+	return true;
+}
+
+/* Operands of the specialized instructions are proven numbers by the verifier. */
+#define BINARY_I32(packer, op)						\
+	do {											\
+		i32 b = NUM_UNPACK(pop());					\
+		i32 a = NUM_UNPACK(pop());					\
+		push(packer(a op b));						\
+	} while (0)
 
-	i32 b = NUM_UNPACK(pop());
-	i32 a = NUM_UNPACK(pop());
+/* The arithmetic wraps around on overflow like the compiler's folding: it's done on
+ * uint32_t, where that's defined. */
+#define ARITH_I32(op)								\
+	do {											\
+		uint32_t b = (uint32_t)NUM_UNPACK(pop());	\
+		uint32_t a = (uint32_t)NUM_UNPACK(pop());	\
+		push(NUM_PACK((i32)(a op b)));				\
+	} while (0)
 
+/**
+ * Divides by a constant with a multiply instead of a division: the high half of
+ * the product with the divisor's magic number (see the compiler), shifted, is the
+ * quotient rounded toward minus infinity, adding one to a negative one rounds it
+ * toward zero like 'div' does.
+ * @returns i32: the quotient.
+ */
+i32
+divideByMagic(i32 x, i32 magic, uint8_t flags)
+{
+	i32 q = (i32)(((int64_t)x * magic) >> 32);
 
-	switch (opType) {
-		case op_add: push(NUM_PACK(a + b));  break;
-		case op_sub: push(NUM_PACK(a - b));  break;
-		case op_mul: push(NUM_PACK(a * b));  break;
-		case op_div: push(NUM_PACK(a / b));  break;
-		case op_gt:  push(BOOL_PACK(a > b)); break;
-		case op_lt:  push(BOOL_PACK(a < b)); break;
-		default: return false;
-	}
-	return true;
+	if (flags & MAGIC_ADD)
+		q = (i32)((uint32_t)q + (uint32_t)x);
+
+	q >>= (flags & MAGIC_SHIFT);
+	return q + (i32)((uint32_t)x >> 31);
 }
 
-static InterpretResult
-run(void)
+/* The operand of the instruction being executed: a word carries it already decoded,
+ * a byte-encoded one is read here, by the instructions which have one. */
+#define OPERAND(width) (words ? operand : readBytes(width))
+
+/**
+ * The dispatch loop for one encoding. It's inlined into run() once per encoding with
+ * 'words' a constant, so neither the test of the encoding nor a loop over the operand
+ * width is left in the dispatch of an instruction.
+ * @returns InterpretResult: how the code ended.
+ */
+static inline __attribute__ ((always_inline)) InterpretResult
+execute(const bool words)
 {
+	uint32_t operand = 0;
 	OpCode ins;
+
 	while (true) {
-		ins = readByteCode();
+		if (words) {
+			uint32_t word = loadU32(vm.ip);
+			vm.ip += INSTRUCTION_WORD;
+			operand = word >> 8;
+			ins = (uint8_t)word;
+		} else {
+			ins = *vm.ip++;
+		}
+
 		switch (ins) {
-			case op_iconst:
-			case op_iconstw:
-			{
-				Value constant = readConst(ins);
-				push(constant);
-			} break;
-			case op_obj_str:
-			case op_obj_strw: {
-				ObjString* str = readObjString(ins);
-				push(OBJ_PACK(str));
-			} break;
+			case op_iconst:   push(vm.bCode->constants.values[OPERAND(1)]); break;
+			case op_iconstw:  push(vm.bCode->constants.values[OPERAND(2)]); break;
+			case op_iconstl:  push(vm.bCode->constants.values[OPERAND(3)]); break;
+			case op_obj_str:  push(OBJ_PACK(vm.bCode->strings[OPERAND(1)])); break;
+			case op_obj_strw: push(OBJ_PACK(vm.bCode->strings[OPERAND(2)])); break;
+			case op_obj_strl: push(OBJ_PACK(vm.bCode->strings[OPERAND(3)])); break;
+			case op_zero:     push(NUM_PACK(0));                break;
+			case op_one:      push(NUM_PACK(1));                break;
+			case op_push_i8:  push(NUM_PACK((int8_t)OPERAND(1)));  break;
+			case op_push_i16: push(NUM_PACK((int16_t)OPERAND(2))); break;
 			case op_null:  push(NULL_PACK());      break;
 			case op_true:  push(BOOL_PACK(true));  break;
 			case op_false: push(BOOL_PACK(false)); break;
@@ -174,8 +281,15 @@ run(void)
 				Value a = pop();
 				push(BOOL_PACK(valuesEqual(a, b)));
 			} break;
+			case op_neq: {
+				Value b = pop();
+				Value a = pop();
+				push(BOOL_PACK(!valuesEqual(a, b)));
+			} break;
 			case op_gt:
 			case op_lt:
+			case op_ge:
+			case op_le:
 			case op_add:
 			case op_sub:
 			case op_mul:
@@ -184,6 +298,35 @@ run(void)
 				if(!binaryOp(ins))
 					return INTERPRET_RUNTIME_ERROR;
 			} break;
+			case op_add_i32: ARITH_I32(+);  break;
+			case op_sub_i32: ARITH_I32(-);  break;
+			case op_mul_i32: ARITH_I32(*);  break;
+			case op_gt_i32:  BINARY_I32(BOOL_PACK, >);  break;
+			case op_lt_i32:  BINARY_I32(BOOL_PACK, <);  break;
+			case op_ge_i32:  BINARY_I32(BOOL_PACK, >=); break;
+			case op_le_i32:  BINARY_I32(BOOL_PACK, <=); break;
+			case op_concat_str: concatenate(2); break;
+			case op_concat:     concatenate(OPERAND(1)); break;
+			case op_shl: push(NUM_PACK((i32)((uint32_t)NUM_UNPACK(pop()) << OPERAND(1)))); break;
+			case op_sar: {
+				// Biasing a negative dividend by 2^shift - 1 rounds toward zero.
+				uint32_t shift = OPERAND(1);
+				i32 x = NUM_UNPACK(pop());
+				push(NUM_PACK((i32)(x + (i32)((uint32_t)(x >> 31) >> (32 - shift))) >> shift));
+			} break;
+			case op_mulhi: {
+				uint32_t magicOperand = OPERAND(3);
+				i32 magic = NUM_UNPACK(vm.bCode->constants.values[magicOperand >> 8]);
+				push(NUM_PACK(divideByMagic(NUM_UNPACK(pop()), magic, (uint8_t)magicOperand)));
+			} break;
+			case op_dup:  push(peek(0)); break;
+			case op_over: push(peek(1)); break;
+			case op_swap: {
+				Value b = pop();
+				Value a = pop();
+				push(b);
+				push(a);
+			} break;
 			case op_not: {
 				push(BOOL_PACK(isFalsey(pop())));
 			} break;
@@ -194,21 +337,60 @@ run(void)
 					return INTERPRET_RUNTIME_ERROR;
 				}
 
-				push(NUM_PACK(-NUM_UNPACK(pop())));
+				push(NUM_PACK((i32)(0u - (uint32_t)NUM_UNPACK(pop()))));
 			} break;
 			case op_ret:
 			{
-				printValue(pop());
-				printf("\n");
-				return INTERPRET_OK;
-			}
+				Value result = pop();
+				if (!vm.quiet) {
+					printValue(result);
+					printf("\n");
+				}
+
+				// A linked image runs its modules one after another.
+				if (vm.ip == vm.bCode->code + vm.bCode->count)
+					return INTERPRET_OK;
+			} break;
+			case op_count:
+				return INTERPRET_RUNTIME_ERROR; // Unreachable, rejected by the verifier.
 		}
 	}
 }
 
+#undef OPERAND
+
+static InterpretResult
+run(void)
+{
+	if (vm.bCode->encoding == enc_words)
+		return execute(true);
+
+	return execute(false);
+}
+
+/* Interns every string of the module's object pool once, so 'op_obj_str' only has
+ * to pick the prepared object and equal strings are always the same object. */
+void
+resolveStrings(ByteCode* bCode)
+{
+	ObjPool* objPool = &bCode->objects;
+	if (bCode->strings != NULL || objPool->count == 0)
+		return;
+
+	bCode->strings = ALLOCATE(ObjString*, objPool->count);
+	for (uint32_t i = 0; i < objPool->count; ++i) {
+		PoolString* entry = &objPool->entries[i];
+		bCode->strings[i] = copyHashedString(OBJPOOL_STR_CHARS(objPool, i), entry->len, entry->hash);
+	}
+}
+
+/** Runs the given bytecode, which must have passed verifyByteCode(). */
 InterpretResult
 interpret(ByteCode* bCode)
 {
+	resolveStrings(bCode);
+	reserveStack(bCode->maxStack);
+	resetStack();
 	vm.bCode = bCode;
 	vm.ip = vm.bCode->code;
 	InterpretResult result = run();
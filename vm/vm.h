@@ -7,15 +7,15 @@
 #include "value.h"
 #include "hash_table.h"
 
-#define STACK_SIZE (8)
-
 typedef struct {
 	ByteCode* bCode;
 	uint8_t*  ip;	       /* <! Instruction pointer. Points to the next bytecode to be used. */
-	Value     stack[STACK_SIZE];
+	Value*    stack;       /* <! Sized for the deepest stack the verifier found in the code. */
+	uint32_t  stackSize;
 	Value*    stackTop;    /* <! Points to the element just past the last item on the stack. */
 	Table     strings;
 	Obj*      objects;
+	bool      quiet;       /* <! 'ret' doesn't print the result, set while benchmarking. */
 } VM;
 
 typedef enum {
@@ -32,4 +32,12 @@ InterpretResult interpret(ByteCode* bCode);
 void push(Value value);
 Value pop(void);
 
+/* Shared with the register backend, see regvm.h. */
+void resolveStrings(ByteCode* bCode);
+void runtimeErrorAt(uint32_t offset, const char* format, ...);
+bool isFalsey(Value value);
+ObjString* concatStrings(const Value* pieces, uint32_t count);
+const char* binaryValues(OpCode op, Value a, Value b, Value* result);
+i32 divideByMagic(i32 x, i32 magic, uint8_t flags);
+
 #endif /* FUNVM_VM_H */
\ No newline at end of file
@@ -1,79 +1,116 @@
 #include "common.h"
 #include "vm.h"
+#include "module.h"
+#include "archive.h"
+#include "verifier.h"
+#include "regvm.h"
+#include "globals.h"
+#include <time.h>
 
 static void
 usage(void)
 {
-	printf("Usage:\n\tfunvmc <source.fn>\n\tfunvm source.fnb\n");
+	printf("Usage:\n\tfunvmc <source.fn>\n\tfunvm [--mmap] [--regs] [--bench <runs>] source.fnb\n");
+	printf("\tfunvm [--mmap] [--regs] [--bench <runs>] archive.fva module\n");
+	printf("\t--regs runs the code on the register backend.\n");
+	printf("\t--bench runs the code the given number of times and reports the time it took,\n\t\twithout printing the results.\n");
 	exit(1);
 }
 
+/** Loads and verifies the module either by reading it into memory or, if 'mapped'
+ * is set, by mapping the file and executing it in place. If 'name' is given, 'path'
+ * is an archive and only that module of it is loaded. */
 static void
-deserializeByteCode(const char* path, ByteCode* bCode)
+deserializeByteCode(const char* path, const char* name, Archive* archive, ByteCode* bCode, bool mapped)
 {
-	size_t fileSize;
-	FILE* file;
+	bool loaded;
 
-	uint8_t* buffer;
-	uint8_t* pBuf; 
-	size_t bytesRead;
-	ConstPool* cPool = &bCode->constants;
-	ObjPool* objPool = &bCode->objects;
-
-	file = fopen(path, "rb");
-	if (NULL == file) {
-		fprintf(stderr, "Couldn't open source file '%s'.\n", path);
-		exit(74);
+	if (name != NULL) {
+		loaded = openArchive(archive, path, mapped) && loadArchiveModule(archive, name, bCode);
+	} else {
+		loaded = mapped ? mapModule(path, bCode) : readModule(path, bCode);
 	}
 
-	fseek(file, 0L, SEEK_END);	/* Move file prt to EOF. */
-	fileSize = ftell(file);		/* How far we are from the start of file? */
-	rewind(file);				/* Rewind file ptr back to the beginning. */
-
-	buffer = ALLOCATE(uint8_t, fileSize);
-	pBuf = buffer;
+	if (!loaded)
+		exit(74);
 
-	bytesRead = fread(pBuf, sizeof(char), fileSize, file);
-	if (bytesRead < fileSize) {
-		fprintf(stderr, "Couldn't read source file '%s'.\n", path);
-		exit(76);
+	if (!verifyByteCode(bCode)) {
+		fprintf(stderr, "Binary file '%s' is malformed.\n", path);
+		exit(74);
 	}
+}
 
-	memcpy(&bCode->count,    pBuf += 0, 4);
-	memcpy(&bCode->capacity, pBuf += 4, 4);
-	memcpy(&cPool->count,    pBuf += 4, 4);
-	memcpy(&cPool->capacity, pBuf += 4, 4);
-	memcpy(&objPool->size,   pBuf += 4, 4);
-
-	bCode->code     = ALLOCATE(uint8_t, bCode->capacity);
-	cPool->values   = ALLOCATE(Value, cPool->capacity * sizeof(Value));
-	objPool->values = ALLOCATE(uint8_t, objPool->size);
-	
-	memcpy(bCode->code,     pBuf += 4, bCode->capacity);
-	memcpy(cPool->values,   pBuf += bCode->capacity, cPool->capacity * sizeof(Value));
-	memcpy(objPool->values, pBuf += (cPool->capacity * sizeof(Value)), objPool->size);
-
-	FREE(uint8_t, buffer);
-	fclose(file);
+/** Runs the code on the register backend if it's been translated for it. */
+static InterpretResult
+execute(ByteCode* bCode, RegCode* rCode)
+{
+	return (rCode != NULL) ? runRegisters(bCode, rCode) : interpret(bCode);
 }
 
 int
 main(int argc, char* argv[])
 {
-	if (argc != 2)
+	bool mapped = false;
+	bool registers = false;
+	long runs = 0;
+	const char* path = NULL;
+	const char* name = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--mmap") == 0)
+			mapped = true;
+		else if (strcmp(argv[i], "--regs") == 0)
+			registers = true;
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+			runs = strtol(argv[++i], NULL, 10);
+		else if (path == NULL)
+			path = argv[i];
+		else if (name == NULL)
+			name = argv[i];
+		else
+			usage();
+	}
+
+	if (path == NULL)
 		usage();
 	
 	ByteCode bCode;
+	Archive archive;
 #if defined(FUNVM_MEM_MANAGER)
 	heapInit();
 #endif
 	initByteCode(&bCode);
-	deserializeByteCode(argv[1], &bCode);
+	deserializeByteCode(path, name, &archive, &bCode, mapped);
 
 	initVM();
-	interpret(&bCode);
-	
+	// The code is translated once, like it's loaded once.
+	RegCode regCode;
+	RegCode* rCode = registers ? &regCode : NULL;
+	if (registers && !translateRegisters(&bCode, rCode)) {
+		fprintf(stderr, "Binary file '%s' is too big for the register backend.\n", path);
+		exit(74);
+	}
+
+	if (runs > 0) {
+		// Only the execution is timed, not the printing of its results.
+		vm.quiet = true;
+		clock_t start = clock();
+		for (long i = 0; i < runs; ++i)
+			execute(&bCode, rCode);
+
+		double ms = 1000.0 * (double)(clock() - start) / CLOCKS_PER_SEC;
+		fprintf(stderr, "%ld runs in %.3f ms, %.3f us per run.\n", runs, ms, 1000.0 * ms / runs);
+	} else {
+		execute(&bCode, rCode);
+	}
+
+	if (rCode != NULL)
+		freeRegCode(rCode);
+
 	freeByteCode(&bCode);
+	if (name != NULL)
+		closeArchive(&archive);
+
 	freeVM();
 	return (0);
 }
\ No newline at end of file